@@ -2,6 +2,25 @@
 #include <vector>
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <deque>
+#include <memory>
+#include <bitset>
+#include <random>
+#include <iomanip>
+#include <chrono>
+#include <sstream>
+#include <type_traits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 using namespace std;
 /*
@@ -28,10 +47,19 @@ using namespace std;
 // To solve the problem, it is conveninent to mark values/digits excluded ats
 //  each square. 8-bit unsigned int is sufficient for this task.
 //  Thus, we use the following typedefs.
+// Puzzles read at run time may have regions of up to 32 squares; the state
+// then takes 16 or 32 bit marks (see mark_for<>), the built-in size keeps 8.
 
 typedef int8_t   numb_t; // to represent "1 through N" or region number
 typedef uint8_t  mark_t; // excluded values marks
 
+constexpr int nd = 32; // n of digits, max region size
+constexpr int nb = 8;  // max region size of 8-bit marks, the bitboard engine,
+                       // rule M and the generator
+
+template <int N> using mark_for = // marks for regions of up to N squares
+  typename conditional<N <= 8, uint8_t, typename conditional<N <= 16, uint16_t, uint32_t>::type>::type;
+
 //******************************************************************************
 // We have a table of 9 x 9 squares
 
@@ -54,10 +82,6 @@ constexpr numb_t
                           {15, 15, 15, 16, 16, 16, 18, 19, 19 },
                           {15, 16, 16, 16, 18, 18, 18, 18, 19 } };
 
-//******************************************************************************
-// Region is a collection of squares (vector of coordinate pairs)
-vector<vector<pair<int,int>>> regs; // lists of regions, to be initialized
-
 //******************************************************************************
 // some squares have initially known values
 
@@ -86,63 +110,660 @@ constexpr numb_t  //
                           { 3,  1,  1,  5,  2,  1,  2,  4,  5 },
                           { 5,  2,  3,  2,  4,  6,  1,  1,  3 },
                           { 4,  3,  8,  7,  3,  4,  2,  5,  2 } };
+constexpr int answerH = 6092; // sum() of knownH
+
+//******************************************************************************
+// The built-in puzzle solved at compile time (constexpr, C++14): the regions
+// as lists, then passes over the squares in order until one changes nothing.
+// c_rules() applies one rule per square: Z at a known square, else X, else R,
+// else Y, and constrains a value as soon as it is set, so the order differs
+// from state::sweep(), which runs each rule over the whole table in turn.
+// Trials in value order at the first unknown square follow. static_assert
+// checks the result against knownH and answerH, and -c prints it without
+// solving anything at run time.
+
+constexpr int c_nreg() { // n of regions
+  int m = 0;
+  for ( int q = 0; q < tr*tc; q++ ) if ( sq2reg[q / tc][q % tc] >= m ) m = sq2reg[q / tc][q % tc] + 1;
+  return m;
+}
+constexpr int nreg = c_nreg();
+
+struct cregions {
+  int size[nreg];     // n of squares of region s
+  int first[nreg+1];  // squares of region s: sq[first[s]..first[s+1])
+  int sq[tr*tc];      // as q = r*tc+c
+};
+constexpr cregions c_regions() {
+  cregions g{};
+  int      fill[nreg] = {};
+  for ( int q = 0; q < tr*tc; q++ ) g.size[sq2reg[q / tc][q % tc]]++;
+  for ( int s = 0; s < nreg; s++ ) g.first[s+1] = g.first[s] + g.size[s];
+  for ( int q = 0; q < tr*tc; q++ ) {
+    const int s = sq2reg[q / tc][q % tc];
+    g.sq[g.first[s] + fill[s]++] = q;
+  }
+  return g;
+}
+constexpr cregions cregs = c_regions();
+
+struct ctable {
+  numb_t n[tr][tc]; // known or assumed value
+  mark_t x[tr][tc]; // marks excluded values
+  bool   ok;        // no conflict found
+};
+constexpr int    c_size(int q) { return cregs.size[sq2reg[q / tc][q % tc]]; }
+constexpr mark_t c_bit(int m)  { return mark_t(0x01 << (m-1)); }
+constexpr int    c_partner(int q, int d, int m) { // square m away in direction d, -1 if none
+  const int r = q / tc + (d == 0 ? m : d == 1 ? -m : 0);
+  const int c = q % tc + (d == 2 ? m : d == 3 ? -m : 0);
+  return r >= 0 && r < tr && c >= 0 && c < tc ? r*tc+c : -1;
+}
+constexpr bool c_exclude(ctable& t, int p, int m) { // m not at p; false on conflict
+  numb_t& n = t.n[p / tc][p % tc];
+  mark_t& x = t.x[p / tc][p % tc];
+  if ( n ) return n != m;
+  x |= c_bit(m);
+  return x != mark_t(~0);
+}
+constexpr bool c_set(ctable& t, int q, int m) { // n at q is m, constrained around
+  t.n[q / tc][q % tc] = m;
+  t.x[q / tc][q % tc] = mark_t(~c_bit(m));
+  bool ok = true;
+  for ( int d = 0; d < 4; d++ ) {
+    for ( int k = 1; k < m; k++ ) if ( c_partner(q,d,k) >= 0 ) ok = ok && c_exclude(t,c_partner(q,d,k),m);
+  }
+  const int s = sq2reg[q / tc][q % tc];
+  for ( int i = cregs.first[s]; i < cregs.first[s+1]; i++ ) {
+    if ( cregs.sq[i] != q ) ok = ok && c_exclude(t,cregs.sq[i],m);
+  }
+  return ok;
+}
+constexpr bool c_rules(ctable& t, int q) { // X, R, Z and Y at q; true if something changed
+  const int r = q / tc, c = q % tc, ss = c_size(q);
+  if ( t.n[r][c] ) { // Z
+    const int m = t.n[r][c];
+    int op = 0, p = -1;
+    for ( int d = 0; d < 4; d++ ) {
+      const int e = c_partner(q,d,m);
+      if ( e < 0 ) continue;
+      if ( t.n[e / tc][e % tc] == m ) return false;
+      if ( !t.n[e / tc][e % tc] && !(t.x[e / tc][e % tc] & c_bit(m)) ) { op++; p = e; }
+    }
+    if ( op != 1 ) return false;
+    t.ok = c_set(t,p,m);
+    return true;
+  }
+  int w = ~t.x[r][c] & ((0x01 << ss) - 1); // X: values left
+  if ( !w ) { t.ok = false; return false; }
+  if ( !(w & (w - 1)) ) {
+    int m = 1;
+    while ( !(w & c_bit(m)) ) m++;
+    t.ok = c_set(t,q,m);
+    return true;
+  }
+  const int s = sq2reg[r][c];
+  for ( int i = cregs.first[s]; i < cregs.first[s+1]; i++ ) { // R: values left only here
+    const int e = cregs.sq[i];
+    if ( e != q ) w &= t.x[e / tc][e % tc];
+  }
+  if ( w & (w - 1) ) { t.ok = false; return false; }
+  if ( w ) {
+    int m = 1;
+    while ( !(w & c_bit(m)) ) m++;
+    t.ok = c_set(t,q,m);
+    return true;
+  }
+  bool moved = false;
+  for ( int m = 1; m <= ss; m++ ) { // Y: no square for the partner
+    if ( t.x[r][c] & c_bit(m) ) continue;
+    bool reach = false;
+    for ( int d = 0; d < 4; d++ ) {
+      const int e = c_partner(q,d,m);
+      reach = reach || (e >= 0 && !(t.x[e / tc][e % tc] & c_bit(m)));
+    }
+    if ( reach ) continue;
+    moved = true;
+    if ( !c_exclude(t,q,m) ) { t.ok = false; return true; }
+  }
+  return moved;
+}
+constexpr bool c_valid(const ctable& t) { // do the values solve the puzzle?
+  for ( int q = 0; q < tr*tc; q++ ) {
+    const int m = t.n[q / tc][q % tc];
+    int dist = 0; // to the nearest m
+    for ( int k = 1; k <= m && !dist; k++ ) {
+      for ( int d = 0; d < 4; d++ ) {
+        const int e = c_partner(q,d,k);
+        if ( e >= 0 && t.n[e / tc][e % tc] == m ) dist = k;
+      }
+    }
+    if ( !m || dist != m ) return false;
+  }
+  return true; // region values are distinct by c_set()
+}
+constexpr ctable c_solve(ctable t) { // fixpoint, then trials at the first unknown square
+  bool moved = true;
+  while ( moved && t.ok ) {
+    moved = false;
+    for ( int q = 0; q < tr*tc && t.ok; q++ ) moved = c_rules(t,q) || moved;
+  }
+  if ( !t.ok ) return t;
+  int q = 0;
+  while ( q < tr*tc && t.n[q / tc][q % tc] ) q++;
+  if ( q == tr*tc ) { t.ok = c_valid(t); return t; }
+  for ( int m = 1; m <= c_size(q); m++ ) {
+    if ( t.x[q / tc][q % tc] & c_bit(m) ) continue;
+    ctable u = t;
+    u.ok = c_set(u,q,m);
+    if ( u.ok ) u = c_solve(u);
+    if ( u.ok ) return u;
+  }
+  t.ok = false;
+  return t;
+}
+constexpr ctable c_start() { // known values set and constrained
+  ctable t{};
+  t.ok = true;
+  for ( int q = 0; q < tr*tc; q++ ) t.x[q / tc][q % tc] = mark_t(~((0x01 << c_size(q)) - 1));
+  for ( int q = 0; q < tr*tc; q++ ) {
+    if ( known[q / tc][q % tc] ) t.ok = c_set(t,q,known[q / tc][q % tc]) && t.ok;
+  }
+  return t;
+}
+constexpr int c_sum(const ctable& t) { // as sum(): largest number across a row of each region
+  int sig = 0;
+  for ( int s = 0; s < nreg; s++ ) {
+    int max = 0;
+    for ( int i = cregs.first[s]; i < cregs.first[s+1]; i++ ) {
+      const int r = cregs.sq[i] / tc;
+      int c = cregs.sq[i] % tc, v = 0;
+      while ( c && sq2reg[r][c-1] == s ) c--;
+      for ( ; c < tc && sq2reg[r][c] == s; c++ ) v = 10 * v + t.n[r][c];
+      if ( v > max ) max = v;
+    }
+    sig += max;
+  }
+  return sig;
+}
+constexpr bool c_same(const ctable& t, const numb_t (&h)[tr][tc]) {
+  for ( int q = 0; q < tr*tc; q++ ) if ( t.n[q / tc][q % tc] != h[q / tc][q % tc] ) return false;
+  return true;
+}
+
+constexpr ctable solvedC = c_solve(c_start());
+static_assert( solvedC.ok && c_same(solvedC,knownH), "the built-in puzzle does not solve to knownH" );
+constexpr int answerC = c_sum(solvedC);
+static_assert( answerC == answerH, "the built-in puzzle does not give answerH" );
 
 
+//******************************************************************************
+// The table above is built in. Other puzzles are read at run time from text:
+// the table size, then the region of each square, then the initially known
+// values (0 where unknown). Anything after '#' on a line is a comment.
+// The puzzle above reads
+//
+//   9 9
+//    0  1  1  1  2  3  4  5  6
+//    0  7  1  2  2  2  4  6  6
+//   ...
+//    0  0  0  0  0  0  0  0  0
+//    0  0  0  0  0  0  0  1  0
+//   ...
+//
+// Region ids are renumbered 0, 1, 2, ... in order of appearance.
+
+struct puzzle {
+  int tr = 0; // table, number of rows
+  int tc = 0; // table, number of columns
+  vector<int> sq2reg; // region of square (r,c), at r*tc+c
+  vector<int> known;  // initially known values, at r*tc+c
+  // Region is a collection of squares (vector of coordinate pairs)
+  vector<vector<pair<int,int>>> regs; // lists of regions
+  // Flat tables for the solver, q = r*tc+c; direction d is down, up, right, left
+  vector<int> rsize;  // size of the region of square q
+  vector<int> rfirst; // squares of region s: rsq[rfirst[s]..rfirst[s+1])
+  vector<int> rsq;
+  int         nv = 0; // largest value, the size of the largest region
+  vector<int> ray;    // (q*4+d)*nv+k: square k+1 away from q in direction d
+  vector<int> rlen;   // q*4+d: n of squares in the ray, up to nv
+  vector<int> wfirst; // squares whose rules read q: wsq[wfirst[q]..wfirst[q+1])
+  vector<int> wsq;
+  void init_regs() {
+    regs.clear();
+    for ( int i = 0; i < tr; i++ ) {
+      for ( int j = 0; j < tc; j++ ) {
+        const size_t s = sq2reg[i*tc+j];
+        if ( s >= regs.size() ) regs.resize(s+1);
+        regs[s].emplace_back(i,j);
+      }
+    }
+    init_tables();
+  }
+  void init_tables() {
+    const int dr[4] = { 1, -1, 0,  0 };
+    const int dc[4] = { 0,  0, 1, -1 };
+    rsize.assign(tr*tc,0);
+    rfirst.assign(1,0);
+    rsq.clear();
+    for ( const auto& g : regs ) {
+      for ( auto e : g ) {
+        rsq.push_back(e.first*tc+e.second);
+        rsize[e.first*tc+e.second] = g.size();
+      }
+      rfirst.push_back(rsq.size());
+    }
+    nv = max_region();
+    ray.assign(tr*tc*4*nv,-1);
+    rlen.assign(tr*tc*4,0);
+    for ( int q = 0; q < tr*tc; q++ ) {
+      for ( int d = 0; d < 4; d++ ) {
+        for ( int k = 1; k <= nv; k++ ) {
+          const int i = q / tc + k*dr[d], j = q % tc + k*dc[d];
+          if ( i < 0 || i >= tr || j < 0 || j >= tc ) break;
+          ray[(q*4+d)*nv+k-1] = i*tc+j;
+          rlen[q*4+d] = k;
+        }
+      }
+    }
+    wfirst.assign(1,0);
+    wsq.clear();
+    vector<char> in(tr*tc,false);
+    for ( int q = 0; q < tr*tc; q++ ) {
+      auto add = [&](int p) { if ( !in[p] ) { in[p] = true; wsq.push_back(p); } };
+      add(q);
+      for ( int k = 0; k < nv; k++ ) { // up, down, left, right, as they are scheduled
+        for ( int d : { 1, 0, 3, 2 } ) if ( k < rlen[q*4+d] ) add(ray[(q*4+d)*nv+k]);
+      }
+      const int s = sq2reg[q];
+      for ( int k = rfirst[s]; k < rfirst[s+1]; k++ ) add(rsq[k]);
+      for ( int k = wfirst.back(); k < (int)wsq.size(); k++ ) in[wsq[k]] = false;
+      wfirst.push_back(wsq.size());
+    }
+  }
+  int max_region() const { // size of the largest region
+    size_t max = 0;
+    for ( const auto& g : regs ) if ( g.size() > max ) max = g.size();
+    return max;
+  }
+  static puzzle builtin() { // the table above
+    puzzle pz;
+    pz.tr = ::tr;
+    pz.tc = ::tc;
+    for ( int i = 0; i < ::tr; i++ ) {
+      for ( int j = 0; j < ::tc; j++ ) {
+        pz.sq2reg.push_back(::sq2reg[i][j]);
+        pz.known.push_back(::known[i][j]);
+      }
+    }
+    pz.init_regs();
+    return pz;
+  }
+  void write(ostream& out) const { // in the format read() reads
+    out << tr << ' ' << tc << '\n';
+    for ( int q = 0; q < tr*tc; q++ ) out << setw(3) << sq2reg[q] << (q % tc + 1 < tc ? "" : "\n");
+    for ( int q = 0; q < tr*tc; q++ ) out << setw(3) << known[q]  << (q % tc + 1 < tc ? "" : "\n");
+    out << '\n';
+  }
+  int read(istream& in) {
+    // reads the next puzzle
+    // return : 1 = puzzle read
+    //          0 = end of input
+    //         -1 = malformed puzzle
+    auto next = [&in](int& v) { // next number, skips comments
+      while ( in >> ws && in.peek() == '#' ) in.ignore(1 << 30, '\n');
+      return bool(in >> v);
+    };
+    if ( !next(tr) ) return 0;
+    if ( !next(tc) || tr < 1 || tc < 1 ) return -1;
+    vector<int> ids; // region ids as given
+    sq2reg.assign(tr*tc,0);
+    known.assign(tr*tc,0);
+    for ( auto& s : sq2reg ) {
+      int id;
+      if ( !next(id) ) return -1;
+      s = find(ids.begin(),ids.end(),id) - ids.begin();
+      if ( s == (int)ids.size() ) ids.push_back(id);
+    }
+    for ( auto& k : known ) if ( !next(k) ) return -1;
+    init_regs();
+    if ( max_region() > nd ) return -1;
+    for ( int q = 0; q < tr*tc; q++ ) {
+      if ( known[q] < 0 || known[q] > (int)regs[sq2reg[q]].size() ) return -1;
+    }
+    return 1;
+  }
+};
+
+//******************************************************************************
+// The solver is a template on the table size, so that the usual sizes get
+// loops with constant bounds. Size 0 x 0 stands for any size, given at run
+// time. dims<> holds the size, and grid<> a table of values of either kind.
+
+template <int TR, int TC> struct dims {
+  static constexpr int tr = TR; // table, number of rows
+  static constexpr int tc = TC; // table, number of columns
+  dims(const puzzle& pz) { assert( pz.tr == TR && pz.tc == TC ); }
+};
+template <int TR, int TC> constexpr int dims<TR,TC>::tr;
+template <int TR, int TC> constexpr int dims<TR,TC>::tc;
+
+template <> struct dims<0,0> {
+  int tr; // table, number of rows
+  int tc; // table, number of columns
+  dims(const puzzle& pz) : tr(pz.tr), tc(pz.tc) {}
+};
+
+template <class T, int TR, int TC> struct grid {
+  T v[TR*TC];
+  grid(int, int) {}
+  T*       operator[](int r)       { return v + r*TC; }
+  const T* operator[](int r) const { return v + r*TC; }
+};
+
+template <class T> struct grid<T,0,0> {
+  vector<T> v;
+  int       tc;
+  grid(int r, int c) : v(r*c), tc(c) {}
+  T*       operator[](int r)       { return v.data() + r*tc; }
+  const T* operator[](int r) const { return v.data() + r*tc; }
+};
+
+//******************************************************************************
+// Implications found are recorded in a trace, a few bytes per event (rule,
+// square, digit) in a preallocated buffer, and formatted only at the end, on
+// request. Compile with -DNOTRACE to leave the trace out: add() is then empty
+// and the solver pays nothing for it.
+
+bool quiet = false; // no reports from the solver, e.g. in batch mode
+
+enum rule_t : uint8_t { ruleX, ruleR, ruleZ, ruleY, ruleM }; // Y: excluded by Z rule
+                                                             // M: by region matching
+
+struct event { uint8_t rule, r, c, m; };
+
+#ifndef NOTRACE
+struct trace {
+  vector<event> ev;
+  size_t        cap  = 1 << 16; // max n of events recorded
+  size_t        lost = 0;       // events not recorded, buffer full
+  void add(rule_t rule, int r, int c, int m) {
+    if ( ev.size() >= cap ) { lost++; return; }
+    if ( ev.empty() ) ev.reserve(cap);
+    ev.push_back({rule,uint8_t(r),uint8_t(c),uint8_t(m)});
+  }
+  void clear()   { ev.clear(); lost = 0; }
+  void disable() { clear(); cap = 0; }
+  void print() const {
+    static const char* what[] = { "X implied ", "R implied ", "Z implied ", "X excluded ",
+                                  "M excluded " };
+    for ( const auto& e : ev ) {
+      cout << what[e.rule] << int(e.m) << " at (" << int(e.r) << "," << int(e.c) << "}" << '\n';
+    }
+    if ( lost ) cout << "... " << lost << " more" << '\n';
+    cout << flush;
+  }
+};
+#else
+struct trace {
+  void add(rule_t, int, int, int) {}
+  void clear()   {}
+  void disable() {}
+  void print() const {}
+};
+#endif
+
+//******************************************************************************
+// Profile. Per rule counters of the solver: calls, implications (a value set
+// or excluded), conflicts and passes (full table passes of sweep(), drains of
+// the worklist). Each state counts in its own profile and adds
+// it to the process total when it goes away; -prof file writes the total as
+// JSON at exit. Compile with -DNOPROFILE to leave the counters out.
+// Compile with -DPROFILE_TICKS to time the rules too, in ticks -- cycles on
+// x86, ns elsewhere. Reading the clock costs more than a rule, so only one
+// call in 64 is timed, and the total is estimated from those.
+
+#ifndef NOPROFILE
+inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+struct profile {
+  static const int nrule  = 5;  // X, R, Z, Y, M as rule_t
+  static const int sample = 64; // one call in sample is timed (PROFILE_TICKS)
+  uint64_t calls[nrule]     = {};
+  uint64_t implied[nrule]   = {};
+  uint64_t conflicts[nrule] = {};
+  uint64_t passes[nrule]    = {};
+  uint64_t ticks[nrule]     = {}; // of the timed calls
+  bool timed(rule_t k) const { return calls[k] % sample == 0; }
+  void count(rule_t k, int res) {
+    calls[k]++;
+    implied[k]   += res > 0;
+    conflicts[k] += res < 0;
+  }
+  void count(rule_t k, int res, uint64_t t) { count(k,res); ticks[k] += t; }
+  void pass(rule_t k) { passes[k]++; }
+  void drain() { for ( int k = 0; k < nrule; k++ ) passes[k]++; } // all rules ran
+  void add(const profile& a) {
+    for ( int k = 0; k < nrule; k++ ) {
+      calls[k]     += a.calls[k];
+      implied[k]   += a.implied[k];
+      conflicts[k] += a.conflicts[k];
+      passes[k]    += a.passes[k];
+      ticks[k]     += a.ticks[k];
+    }
+  }
+  void json(ostream& out) const {
+    static const char* name[nrule] = { "X", "R", "Z", "Y", "M" };
+#if !defined(PROFILE_TICKS)
+    out << "{\n  \"rules\": {\n";
+#elif defined(__x86_64__) || defined(__i386__)
+    out << "{\n  \"ticks\": \"cycles\",\n  \"rules\": {\n";
+#else
+    out << "{\n  \"ticks\": \"ns\",\n  \"rules\": {\n";
+#endif
+    for ( int k = 0; k < nrule; k++ ) {
+      out << "    \"" << name[k] << "\": { \"calls\": " << calls[k]
+          << ", \"implied\": " << implied[k] << ", \"conflicts\": " << conflicts[k]
+          << ", \"passes\": " << passes[k];
+#ifdef PROFILE_TICKS
+      out << ", \"ticks\": " << ticks[k] * sample;
+#endif
+      out << " }" << (k + 1 < nrule ? ",\n" : "\n");
+    }
+    out << "  }\n}\n";
+  }
+};
+
+struct profile_total { // of all states, written to file at exit
+  mutex   m;
+  profile p;
+  string  file;
+  void add(const profile& a) { lock_guard<mutex> lk(m); p.add(a); }
+  ~profile_total() {
+    if ( file.empty() ) return;
+    ofstream out(file);
+    p.json(out);
+  }
+} profiles;
+#else
+inline uint64_t ticks() { return 0; }
+struct profile {
+  bool timed(rule_t) const { return false; }
+  void count(rule_t, int, uint64_t = 0) {}
+  void pass(rule_t) {}
+  void drain() {}
+};
+struct profile_total {
+  string file;
+  void add(const profile&) {}
+} profiles;
+#endif
+
 //******************************************************************************
 // To solve the problem it is conveninent to keep track of known/assumed
 // values and excluded values for each sqare. At this stage we may not know
 // if all subsequent values are implied, or we will have apply a
 // "try-and-error" procedure. Thus, compuational state should not be
-// defined as a static table -- we may need a stack of them.
-                          
-struct state {
-    numb_t n[tr][tc]; // known or assumed value
-    mark_t x[tr][tc]; // marks excluded values
+// defined as a static table. Instead of a stack of states, every change of
+// n or x is recorded on a trail, and undo() rolls the state back to an
+// earlier trail mark when a trial fails.
+//
+// imply() does not sweep the table. A square whose n or x changes schedules
+// the squares whose rules read it: its region, and the squares up to nv away
+// in its row and column (a digit there may look for its min distance).
+// Only scheduled squares are visited again.
+//
+// The marks are M, wide enough for the largest region: bit m-1 of x[r][c]
+// excludes value m, and the bits from the region size up are always set, so
+// all values are excluded when x is all ones.
+
+template <int TR, int TC, class M = mark_t>
+struct state : dims<TR,TC> {
+    typedef M mark_t;
+    using dims<TR,TC>::tr;
+    using dims<TR,TC>::tc;
+    trace   events;   // implications found
+    profile prof;     // counters per rule
+    const puzzle* pz; // regions, known values
+    grid<numb_t,TR,TC> n; // known or assumed value
+    grid<mark_t,TR,TC> x; // marks excluded values
+    grid<char,TR,TC>   pend; // square scheduled for imply()
+    grid<int,TR,TC>    work; // worklist of scheduled squares, circular
+    int    whead;        // first scheduled square in work
+    int    wsize;        // n of scheduled squares
+    vector<char> rdirty; // region changed since its m_imply()
+    enum by_t : uint8_t { byDecision, byConstrain, byX, byR, byZ, byY, byM };
+    struct change { // square, its old n, x, and the rule that changed it
+      int q; int at; by_t by; uint8_t m; numb_t n; mark_t x; // rule by at square at, value m
+    };
+    vector<change> trail; // changes of n and x, for undo()
+    by_t    by  = byDecision; // the rule making changes now,
+    int     at  = -1;         // at square
+    uint8_t bym = 0;          // for value
+    void because(by_t b, int r, int c, int m = 0) { by = b; at = r*tc+c; bym = m; }
+    vector<int> clash;    // squares whose state gave the last conflict
+    vector<size_t> dmark; // trail mark of each decision of branch(), level 1, 2, ...
+    vector<vector<pair<int,int>>> nogoods; // learned: squares and values not all together
+    size_t nglast = 0;    // nogood replaced next
+    static const size_t ngcap  = 256; // max n of nogoods
+    static const size_t ngsize = 8;   // max n of values in a nogood
+    void save(int q) { trail.push_back({q, at, by, bym, n[0][q], x[0][q]}); }
+    void save(int r, int c) { save(r*tc+c); }
+    void undo(size_t mark) { // restore n and x as they were at trail mark
+      while ( trail.size() > mark ) {
+        const auto& e = trail.back();
+        n[0][e.q] = e.n;
+        x[0][e.q] = e.x;
+        trail.pop_back();
+      }
+      fill(rdirty.begin(),rdirty.end(),true);
+    }
+    void clear_work() {
+      fill(pend[0],pend[0]+tr*tc,false);
+      whead = wsize = 0;
+    }
+    void schedule(int q) {
+      if ( pend[0][q] ) return;
+      pend[0][q] = true;
+      work[0][(whead + wsize++) % (tr*tc)] = q;
+    }
+    void schedule(int r, int c) { schedule(r*tc+c); }
+    void touch(int q) { // n or x of square q changed
+      // schedules the squares whose rules read q (puzzle::wsq), the same as
+      // the squares the rules at q read
+      rdirty[pz->sq2reg[q]] = true;
+      for ( int k = pz->wfirst[q]; k < pz->wfirst[q+1]; k++ ) schedule(pz->wsq[k]);
+    }
+    void touch(int r, int c) { touch(r*tc+c); }
+    static mark_t bit(int m) { return mark_t(1) << (m-1); } // marks value m
+    static mark_t all(int ss) { // marks values 1 to ss
+      return ss < 8 * (int)sizeof(mark_t) ? mark_t((mark_t(1) << ss) - 1) : mark_t(~mark_t(0));
+    }
+    static bool none(mark_t x) { return x == mark_t(~mark_t(0)); } // all values excluded
+    int reg(int r, int c) const { return pz->sq2reg[r*tc+c]; }
+    int size(int r, int c) const { return pz->rsize[r*tc+c]; } // of the region
+    struct span { // squares of a table, as q
+      const int* b;
+      const int* e;
+      const int* begin() const { return b; }
+      const int* end()   const { return e; }
+      int        size()  const { return e - b; }
+      int operator[](int k) const { return b[k]; }
+    };
+    span region(int r, int c) const { // squares of the region of (r,c)
+      const int s = reg(r,c);
+      return { pz->rsq.data() + pz->rfirst[s], pz->rsq.data() + pz->rfirst[s+1] };
+    }
+    span ray(int q, int d, int len) const { // up to len squares from q in direction d
+      const int* b = pz->ray.data() + (q*4+d)*pz->nv;
+      return { b, b + min(len,pz->rlen[q*4+d]) };
+    }
+    int partner(int q, int d, int m) const { // square m away from q in direction d, -1 if none
+      return m <= pz->rlen[q*4+d] ? pz->ray[(q*4+d)*pz->nv+m-1] : -1;
+    }
     void set_n(int r, int c, int m) { 
-      assert(m >= 0 && m <= regs[sq2reg[r][c]].size() );
+      assert(m >= 0 && m <= size(r,c) );
+      save(r,c);
       n[r][c] = m;
-      if ( !m ) x[r][c] = ~0 & ~((0x01 << regs[sq2reg[r][c]].size()) - 1);
-      else      x[r][c] = ~(0x01 << (m-1)); // exclude all but m
+      if ( !m ) x[r][c] = ~all(size(r,c));
+      else      x[r][c] = ~bit(m); // exclude all but m
 //       cout << r << ' ' << c << ' ' << m << ' ' << (int)x[r][c] << endl;
+      touch(r,c);
     }
   public:
-    state() {
+    state(const puzzle& p) : dims<TR,TC>(p), pz(&p), n(p.tr,p.tc), x(p.tr,p.tc),
+                             pend(p.tr,p.tc), work(p.tr,p.tc), rdirty(p.regs.size(),true) {
       // x - excludes values larger than reg size
       // n - according to known;
+      clear_work();
       for ( int i = 0; i < tr; i++ ) {
         for ( int j = 0; j < tc; j++ ) {
-          set_n(i,j,known[i][j]); 
+          set_n(i,j,p.known[i*tc+j]); 
         }
       }
     }
-    state(const state& a)         { copy(a.n[0],a.n[0]+tr*tc,n[0]);  
-                                    copy(a.x[0],a.x[0]+tr*tc,x[0]); } 
-    void operator=(const state& a){ copy(a.n[0],a.n[0]+tr*tc,n[0]);
-                                    copy(a.x[0],a.x[0]+tr*tc,x[0]); } 
+    state(const state& a) : dims<TR,TC>(a), pz(a.pz), n(a.n), x(a.x),
+                            pend(a.pend), work(a.work), rdirty(a.rdirty.size(),true) {
+      clear_work();
+    }
+    ~state() { profiles.add(prof); }
+    void operator=(const state& a){ pz = a.pz;
+                                    copy(a.n[0],a.n[0]+tr*tc,n[0]);
+                                    copy(a.x[0],a.x[0]+tr*tc,x[0]); 
+                                    rdirty.assign(a.rdirty.size(),true);
+                                    clear_work(); } 
     int constrain(int r, int c) { 
       // excludes the value of n[r][c] around n[r][c] (up,down,left,right)
       // excludes the value of n[r][c] in the region of (r,c)
       // returns -1 if it detects assignment conflicts, 1 otherwise 
-      assert( n[r][c] != 0 && n[r][c] <= (int)regs[sq2reg[r][c]].size());
+      assert( n[r][c] != 0 && n[r][c] <= size(r,c));
+      const int    q   = r*tc+c;
       const auto   m   = n[r][c];
-      const mark_t bit = 0x01 << (m-1);
+      const mark_t b   = bit(m);
+      because(byConstrain,r,c);
       
-      auto set = [this,m,bit](int i, int j){
-        if ( n[i][j] ) return n[i][j] != m; // false if same value too close
-        mark_t& e  = x[i][j]; 
-                e |= bit;
-        return ~e != 0; // false if all values excluded
+      auto set = [this,q,m,b](int p){
+        bool ok;
+        if ( n[0][p] ) ok = n[0][p] != m; // false if same value too close
+        else {
+          mark_t& e  = x[0][p]; 
+          if ( !(e & b) ) { save(p); e |= b; touch(p); }
+          ok = !none(e); // false if all values excluded
+        }
+        if ( !ok ) clash = { q, p };
+        return ok;
       };
-      if ( m > 1 ) { 
-        for ( auto i = r + 1; i <  tr && i < r + m; i++ ) if(!set(i,c)) return -1;
-        for ( auto i = r - 1; i >=  0 && i > r - m; i-- ) if(!set(i,c)) return -1;
-        for ( auto j = c + 1; j <  tr && j < c + m; j++ ) if(!set(r,j)) return -1;
-        for ( auto j = c - 1; j >=  0 && j > c - m; j-- ) if(!set(r,j)) return -1;
+      for ( int d = 0; d < 4; d++ ) { // down, up, right, left, m-1 squares
+        for ( int p : ray(q,d,m-1) ) if(!set(p)) return -1;
       }
-      for ( auto e : regs[sq2reg[r][c]] ) {
-        auto i = e.first;
-        auto j = e.second;
-        if ( r != i || c != j ) if(!set(i,j)) return -1;
+      for ( int p : region(r,c) ) {
+        if ( p != q ) if(!set(p)) return -1;
       }
       return true;
     }
@@ -152,8 +773,7 @@ struct state {
       int cntr = 0;
       if ( n[r][c] == 0 ) {
         const auto w  = x[r][c];
-        const auto s  = sq2reg[r][c];
-        const auto ss = regs[s].size();
+        const auto ss = size(r,c);
         for ( int k = 0; k < ss; k++ ) cntr += ((w >> k) & 0x01) ? 0 : 1;
 //         cout << "ss " << ss << endl;
 //         cout << "cntr " << cntr << endl;
@@ -167,92 +787,65 @@ struct state {
       int op = 0;
       if ( n[r][c] ) {
         const auto   m   = n[r][c];
-        const mark_t bit = 0x01 << ( m-1);
-        if ( r - m >= 0 ) { int i = r - m;
-          if ( n[i][c] == m ) return 0;
-          if ( n[i][c] == 0 && (x[i][c] & bit) == 0) op |= 0x01;
-        }
-        if ( r + m < tr ) { int i = r + m;
-          if ( n[i][c] == m ) return 0;
-          if ( n[i][c] == 0 && (x[i][c] & bit) == 0) op |= 0x02;
-        }
-        if ( c - m >= 0 ) { int j = c - m;
-          if ( n[r][j] == m ) return 0;
-          if ( n[r][j] == 0 && (x[r][j] & bit) == 0) op |= 0x04;
-        }
-        if ( c + m < tc ) { int j = c + m;
-          if ( n[r][j] == m ) return 0;
-          if ( n[r][j] == 0 && (x[r][j] & bit) == 0) op |= 0x08;
+        const mark_t b   = bit(m);
+        for ( int d = 0; d < 4; d++ ) { // bit d of op: the square m away in direction d
+          const int p = partner(r*tc+c,d,m);
+          if ( p < 0 ) continue;
+          if ( n[0][p] == m ) return 0;
+          if ( n[0][p] == 0 && (x[0][p] & b) == 0) op |= 0x01 << d;
         }
       }
       return op;
     }
-    void messageX(int r, int c, int m) {
-        cout << "X implied " << m << " at (" << r << "," <<c<<"}" << endl;
-    }
-    void messageR(int r, int c, int m) {
-        cout << "R implied " << m << " at (" << r << "," <<c<<"}" << endl;
-    }
-    void messageZ(int r, int c, int m) {
-        cout << "Z impled " << m << " at (" << r << "," <<c<<"}" << endl;
-    }
-    void messageY(int r, int c, int m) {
-        cout << "X excluded " << m << " at (" << r << "," <<c<<"}" << endl;
-    }
+    void messageX(int r, int c, int m) { events.add(ruleX,r,c,m); }
+    void messageR(int r, int c, int m) { events.add(ruleR,r,c,m); }
+    void messageZ(int r, int c, int m) { events.add(ruleZ,r,c,m); }
+    void messageY(int r, int c, int m) { events.add(ruleY,r,c,m); }
+    void messageM(int r, int c, int m) { events.add(ruleM,r,c,m); }
     int x_imply( int r, int c ) {
       // find a new implication due to exclusion of all but one value
       // return : 0 = no implication
       //          1 = new implication, no conflicts from constrain()
       //         -1 = new implication, a  conflict  from constrain()
       const int choices = x_choices(r,c);
-      if ( choices < 0 ) return -1; // already a conflict?
+      if ( choices < 0 ) { clash = { r*tc+c }; return -1; } // already a conflict?
       if ( choices < 1 ) return  0; // already cosen
       if ( choices > 1 ) return  0; // too many, no implication
 
       const auto w  = x[r][c];
-      const auto s  = sq2reg[r][c];
-      const auto ss = regs[s].size();
+      const auto ss = size(r,c);
       int k = 0;
       for ( ; k < ss; k++ ) if ( ((w >> k) & 0x01) == 0 ) { k++; break; }
+      because(byX,r,c);
       set_n(r,c,k); assert( k > 0 && k <= ss );
       messageX(r,c,k);
       return constrain(r,c);
     }
     int r_imply( int r, int c ) {
-      cout << "IN r_imply" << endl;
       // find a new implication due to exclusion in the rest of the region
       // return : 0 = no implication
       //          1 = new implication, no conflicts from constrain()
       //         -1 = new implication, a  conflict  from constrain()
       if ( n[r][c] ) return 0;
-      const auto w  = ~x[r][c]; // w identifies possible values
-//       for(auto i = 0; i < 9; i++) {
-//           for(auto j = 0; j < 9; j++) {
-//               cout << (int)x[i][j] << " ";
-//         }
-//         cout << endl;
-//     } 
-//       cout << "W: " << (char)w << endl;
-      const auto s  = sq2reg[r][c];
-      const auto ss = regs[s].size();
+      const mark_t w = ~x[r][c]; // w identifies possible values
+      const auto ss = size(r,c);
       mark_t     y  = w; // finds values possible to set only at (r,c)
-      for ( auto e : regs[s] ) {
-        auto i = e.first; 
-        auto j = e.second;
-//         cout << "i,r,j,c " << i << " " << r << " " << j << " " << c << endl;
-        if ( i == r && j == c ) continue;
-        y &= x[i][j]; // eliminate bits not excluded elsewhere
-//         cout << "y: " << (int)y << endl;
+      for ( int p : region(r,c) ) {
+        if ( p == r*tc+c ) continue;
+        y &= x[0][p]; // eliminate bits not excluded elsewhere
       }
       if ( y == 0 ) return 0; // no unique values at (r,c)
       int m    = 0;
       int cntr = 0;
       for ( int k = 0; k < ss; k++ ) {
-//         cout << "Y >> k: " << ((y >> k) & 0x01) << endl;
         if ( (y >> k) & 0x01 ) { cntr++; m = k+1; }
       }
-      if ( cntr > 1 ) return -1;
+      if ( cntr > 1 ) {
+        clash.assign(region(r,c).begin(),region(r,c).end());
+        return -1;
+      }
       messageR(r,c,m);
+      because(byR,r,c);
       set_n(r,c,m);
       return 1;
     }
@@ -263,11 +856,12 @@ struct state {
       //         -1 = new implication, a  conflict  from constrain()
       const int m  = n[r][c];
             int op = z_choices ( r,c );
-      if ( op == 0x01 ) { messageZ(r-m,c,m); set_n(r-m,c,m); return constrain( r-m,c ); }
-      if ( op == 0x02 ) { messageZ(r+m,c,m); set_n(r+m,c,m); return constrain( r+m,c ); }
-      if ( op == 0x04 ) { messageZ(r,c-m,m); set_n(r,c-m,m); return constrain( r,c-m ); }
-      if ( op == 0x08 ) { messageZ(r,c+m,m); set_n(r,c+m,m); return constrain( r,c+m ); }
-      return false;
+      if ( !op || (op & (op - 1)) ) return false; // none or more than one
+      int d = 0;
+      while ( op >> (d+1) ) d++;
+      const int p = partner(r*tc+c,d,m), i = p / tc, j = p % tc;
+      because(byZ,r,c,m);
+      messageZ(i,j,m); set_n(i,j,m); return constrain( i,j );
     }
     int z_constrain( int r, int c, int m) { 
       // find a new constrain due to min distance unsatisfiability
@@ -284,49 +878,117 @@ struct state {
       
       if ( n[r][c] ) return 0;
 
-      const mark_t bit = 0x01 << (m-1);
+      const mark_t b = bit(m);
 //       cout << "r,c,m" << r << " " << c << " " << m << endl;
       
-      if ( x[r][c] & bit ) return 0; // if already excluded
+      if ( x[r][c] & b ) return 0; // if already excluded
 
-      if ( r - m >= 0 ) { int i = r - m; if (( x[i][c] & bit ) == 0 ) return 0; }
-      if ( r + m < tr ) { int i = r + m; if (( x[i][c] & bit ) == 0 ) return 0; }
-      if ( c - m >= 0 ) { int j = c - m; if (( x[r][j] & bit ) == 0 ) return 0; }
-      if ( c + m < tc ) { int j = c + m; if (( x[r][j] & bit ) == 0 ) return 0; }
+      for ( int d = 0; d < 4; d++ ) {
+        const int p = partner(r*tc+c,d,m);
+        if ( p >= 0 && ( x[0][p] & b ) == 0 ) return 0;
+      }
       messageY(r,c,m);
-      x[r][c] |= bit; 
-      cout << "after bit " << (int)x[r][c] << endl;
-      for(auto i = 0; i < 9; i++) {
-          for(auto j = 0; j < 9; j++) {
-              cout << (int)x[i][j] << " ";
+      because(byY,r,c,m);
+      save(r,c);
+      x[r][c] |= b; 
+      touch(r,c);
+      if ( !none(x[r][c]) ) return 1;
+      clash = { r*tc+c };
+      reads(trail.back(),[this](int q) { clash.push_back(q); });
+      return -1;
+    }
+    int m_imply( int r, int c ) {
+      // find new constrains due to the region as a whole: its squares take
+      // its values one each, so a value that fits in no such matching of
+      // squares to values is excluded. This covers naked and hidden pairs,
+      // triples, ... of the region. Done at the first square of the region,
+      // if the region changed since.
+      // return : 0 = no new constrain
+      //          1 = new constrains
+      //         -1 = conflict, no matching left
+      const span g  = region(r,c);
+      const int  ss = g.size();
+      if ( ss < 3 ) return 0; // nothing beyond x_imply() and r_imply()
+      if ( ss > nb ) return 0; // too many subsets to list
+      if ( g[0] != r*tc+c || !rdirty[reg(r,c)] ) return 0;
+      rdirty[reg(r,c)] = false;
+      const int full = (0x01 << ss) - 1;
+      int can[nb]; // values possible at the k-th square, as bits
+      for ( int k = 0; k < ss; k++ ) {
+        const int p = g[k];
+        can[k] = n[0][p] ? 0x01 << (n[0][p]-1) : ~x[0][p] & full;
+      }
+      // fw[k]: sets of values the squares before k can take, one each
+      // bw[k]: the same for the squares from k on; as lists and as bits
+      struct sets { uint8_t s[70]; int size = 0; }; // at most 8 choose 4
+      sets              fw[nb+1], bw[nb+1];
+      bitset<(1 << nb)> bwin[nb+1];
+      auto step = [](const sets& from, int can, sets& to, bitset<(1 << nb)>& in) {
+        for ( int k = 0; k < from.size; k++ ) {
+          const int s = from.s[k];
+          for ( int b = can & ~s; b; b &= b - 1 ) {
+            const int t = s | (b & -b);
+            if ( !in[t] ) { in[t] = true; to.s[to.size++] = t; }
+          }
         }
-        cout << endl;
+      };
+      fw[0].s[fw[0].size++] = 0;
+      for ( int k = 0; k < ss; k++ ) {
+        bitset<(1 << nb)> in;
+        step(fw[k],can[k],fw[k+1],in);
+      }
+      if ( !fw[ss].size ) {
+        clash.clear();
+        clash.assign(g.begin(),g.end());
+        return -1;
+      }
+      bw[ss].s[bw[ss].size++] = 0;
+      bwin[ss][0] = true;
+      for ( int k = ss - 1; k > 0; k-- ) step(bw[k+1],can[k],bw[k],bwin[k]);
+      int res = 0;
+      for ( int k = 0; k < ss; k++ ) {
+        const int p = g[k];
+        if ( n[0][p] ) continue;
+        int fit = 0; // values of a matching
+        for ( int l = 0; l < fw[k].size; l++ ) {
+          const int s = fw[k].s[l];
+          for ( int b = can[k] & ~s; b; b &= b - 1 ) {
+            if ( bwin[k+1][full ^ s ^ (b & -b)] ) fit |= b & -b;
+          }
+        }
+        const int out = can[k] & ~fit;
+        if ( !out ) continue;
+        because(byM,r,c);
+        save(p);
+        x[0][p] |= out;
+        touch(p);
+        for ( int m = 1; m <= ss; m++ ) if ( (out >> (m-1)) & 0x01 ) messageM(p/tc,p%tc,m);
+        res = 1;
       }
-      return ~x[r][c] == 0 ? -1 : 1;
+      return res;
     }
     int x_imply() // apply all possible x implications
     {
-      cout << "In x_imply" << endl;
       int  cntr = 0;
       bool ok   = true; // no-conflic
+      prof.pass(ruleX);
       for ( int i = 0; i < tr && ok; i++ ) {
         for ( int j = 0; j < tc && ok; j++ ) {
-          auto res = x_imply(i,j);
-          cout << "i,j " << i << " " << j << endl;
+          auto res = timed(ruleX,[&]{ return x_imply(i,j); });
           ok   &= res >= 0;
           cntr += res == 1;
         }
       }
-      cout << "x_imply result: " << ok << ' '<< cntr << endl;
       return ok ? cntr : -1;
     }
     int r_imply() // apply all possible r implications
     {
       int  cntr = 0;
       bool ok   = true; // no-conflic
+      prof.pass(ruleR);
       for ( int i = 0; i < tr && ok; i++ ) {
         for ( int j = 0; j < tc && ok; j++ ) {
-          auto res = r_imply(i,j);
+          auto res = timed(ruleR,[&]{ return r_imply(i,j); });
           ok   &= res >= 0;
           cntr += res == 1;
         }
@@ -337,9 +999,10 @@ struct state {
     {
       int  cntr = 0;
       bool ok   = true; // no-conflic
+      prof.pass(ruleZ);
       for ( int i = 0; i < tr && ok; i++ ) {
         for ( int j = 0; j < tc && ok; j++ ) {
-          auto res = z_imply(i,j);
+          auto res = timed(ruleZ,[&]{ return z_imply(i,j); });
           ok   &= res >= 0;
           cntr += res == 1;
         }
@@ -350,10 +1013,11 @@ struct state {
     {
       int  cntr = 0;
       bool ok   = true; // no-conflic
+      prof.pass(ruleY);
       for ( int i = 0; i < tr && ok; i++ ) {
         for ( int j = 0; j < tc && ok; j++ ) {
-          for ( int m = 1; m <= regs[sq2reg[i][j]].size(); m++ ) {
-            auto res = z_constrain(i,j,m);
+          for ( int m = 1; m <= size(i,j); m++ ) {
+            auto res = timed(ruleY,[&]{ return z_constrain(i,j,m); });
             ok   &= res >= 0;
             cntr += res == 1;
           }
@@ -361,7 +1025,209 @@ struct state {
       }
       return ok ? cntr : -1;
     }
+    template <class F> int timed(rule_t k, F rule) { // rule(), counted in prof
+#ifndef PROFILE_TICKS
+      const int res = rule();
+      prof.count(k,res);
+      return res;
+#else
+      if ( !prof.timed(k) ) {
+        const int res = rule();
+        prof.count(k,res);
+        return res;
+      }
+      const uint64_t t   = ticks();
+      const int      res = rule();
+      prof.count(k,res,ticks() - t);
+      return res;
+#endif
+    }
+    int imply(int r, int c) // apply all rules at (r,c)
+    {
+      int cntr = 0;
+      int res  = 0;
+      res = timed(ruleX,[&]{ return x_imply(r,c); }); if ( res < 0 ) return -1; cntr += res;
+      res = timed(ruleR,[&]{ return r_imply(r,c); }); if ( res < 0 ) return -1; cntr += res;
+      if ( res > 0 && constrain(r,c) < 0 ) return -1; // r_imply() leaves it out
+      res = timed(ruleZ,[&]{ return z_imply(r,c); }); if ( res < 0 ) return -1; cntr += res;
+      for ( int m = 1; m <= size(r,c); m++ ) {
+        if ( timed(ruleY,[&]{ return z_constrain(r,c,m); }) < 0 ) return -1;
+      }
+      if ( timed(ruleM,[&]{ return m_imply(r,c); }) < 0 ) return -1;
+      return cntr;
+    }
     int imply() // find all possible implications and constraints
+    {
+      int cntr = 0; // total number of implications
+      for ( int i = 0; i < tr; i++ ) {
+        for ( int j = 0; j < tc; j++ ) schedule(i,j);
+      }
+      cntr = propagate();
+      if ( !quiet ) cout << "result: " << cntr << endl;
+      return cntr;
+    }
+    int propagate() // apply rules to scheduled squares until none is left
+    {
+      int cntr = 0;
+      if ( wsize ) prof.drain();
+      while ( wsize ) {
+        const int q = work[0][whead];
+        whead = (whead + 1) % (tr*tc);
+        wsize--;
+        pend[q / tc][q % tc] = false;
+        const int res = imply(q / tc, q % tc);
+        if ( res < 0 ) { clear_work(); return -1; }
+        cntr += res;
+      }
+      return cntr;
+    }
+    bool search() // imply(), then try values of the most constrained square
+    {
+      if ( imply() < 0 ) return false;
+      return branch();
+    }
+    bool pick(int& r, int& c) const // find the most constrained unknown square
+    {
+      int min = nd + 1;
+      r = c = -1;
+      for ( int i = 0; i < tr; i++ ) {
+        for ( int j = 0; j < tc; j++ ) {
+          const int choices = x_choices(i,j);
+          if ( choices > 0 && choices < min ) { min = choices; r = i; c = j; }
+        }
+      }
+      return r >= 0;
+    }
+    mark_t values(int r, int c) const { // values still possible at (r,c)
+      return ~x[r][c] & all(size(r,c));
+    }
+    template <class F> void reads(const change& e, F f) const {
+      // f(q) for the squares q whose state the rule of change e read
+      const int r = e.at / tc, c = e.at % tc, m = e.m;
+      auto partners = [&]() { // the squares m away from (r,c)
+        if ( r - m >= 0 ) f((r-m)*tc+c);
+        if ( r + m < tr ) f((r+m)*tc+c);
+        if ( c - m >= 0 ) f(r*tc+c-m);
+        if ( c + m < tc ) f(r*tc+c+m);
+      };
+      switch ( e.by ) {
+        case byConstrain:
+        case byX        : f(e.at); break;
+        case byR        :
+        case byM        : for ( auto p : region(r,c) ) f(p); break;
+        case byZ        : f(e.at); partners(); break;
+        case byY        : partners(); break;
+        default         : break;
+      }
+    }
+    vector<char> reasons(const vector<int>& sqs) const {
+      // the levels of the decisions the state of squares sqs follows from.
+      // Walks the trail back: a change of a relevant square makes the
+      // squares its rule read relevant, a decision gives its level.
+      vector<char> why(dmark.size() + 1,false);
+      vector<char> rel(tr*tc,false);
+      for ( int q : sqs ) rel[q] = true;
+      if ( dmark.empty() ) return why;
+      size_t d = dmark.size();
+      for ( size_t i = trail.size(); i-- > dmark[0]; ) {
+        while ( i < dmark[d-1] ) d--;
+        const auto& e = trail[i];
+        if ( !rel[e.q] ) continue;
+        if ( e.by == byDecision ) why[d] = true;
+        else reads(e,[&rel](int q) { rel[q] = true; });
+      }
+      return why;
+    }
+    int violated() const { // a nogood all of whose values are set, -1 if none
+      for ( size_t k = 0; k < nogoods.size(); k++ ) {
+        bool all = true;
+        for ( auto e : nogoods[k] ) all = all && n[e.first / tc][e.first % tc] == e.second;
+        if ( all ) return k;
+      }
+      return -1;
+    }
+    void learn(const vector<char>& why) { // the decisions of levels why as a nogood
+      vector<pair<int,int>> g;
+      for ( size_t l = 1; l < why.size(); l++ ) {
+        if ( !why[l] ) continue;
+        const int q = trail[dmark[l-1]].q;
+        g.emplace_back(q,n[q / tc][q % tc]);
+      }
+      if ( g.empty() || g.size() > ngsize ) return;
+      if ( nogoods.size() < ngcap ) nogoods.push_back(g);
+      else { nogoods[nglast] = g; nglast = (nglast + 1) % ngcap; }
+    }
+    bool branch() { vector<char> why; return branch(why); }
+    bool branch(vector<char>& why)
+    {
+      // tries the values of the most constrained square. A failed value
+      // gives the levels of the decisions its failure follows from; if the
+      // decision here is not one of them, the other values fail the same
+      // way and the search jumps back past this square. A square that
+      // fails for all values leaves a nogood of the decisions it depends on.
+      // why : on failure, the levels its follows from (below this one)
+      int r, c;
+      const size_t level = dmark.size() + 1; // of the decision made here
+      if ( !pick(r,c) ) { // all squares known
+        if ( valid() ) return true;
+        why.assign(level,true);
+        why[0] = false;
+        return false;
+      }
+      vector<char> fail(level,false); // levels of the failures of the values
+      const size_t mark = trail.size();
+      for ( int m = 1; m <= size(r,c); m++ ) {
+        if ( (x[r][c] >> (m-1)) & 0x01 ) continue;
+        dmark.push_back(mark);
+        because(byDecision,r,c);
+        set_n(r,c,m);
+        vector<char> sub;
+        int k;
+        if ( constrain(r,c) < 0 || propagate() < 0 ) sub = reasons(clash);
+        else if ( (k = violated()) >= 0 ) {
+          vector<int> sqs;
+          for ( auto e : nogoods[k] ) sqs.push_back(e.first);
+          sub = reasons(sqs);
+        }
+        else if ( branch(sub) ) return true;
+        clear_work();
+        undo(mark);
+        dmark.pop_back();
+        sub.resize(level+1,false);
+        if ( !sub[level] ) { // not due to this square: jump back
+          sub.resize(level);
+          why = sub;
+          return false;
+        }
+        for ( size_t l = 0; l < level; l++ ) fail[l] |= sub[l];
+      }
+      learn(fail);
+      why = fail;
+      return false;
+    }
+    bool valid() const { // do the known values solve the puzzle?
+      for ( const auto& g : pz->regs ) {
+        mark_t seen = 0;
+        for ( auto e : g ) {
+          const int m = n[e.first][e.second];
+          if ( m < 1 || m > int(g.size()) || (seen & bit(m)) ) return false;
+          seen |= bit(m);
+        }
+      }
+      for ( int i = 0; i < tr; i++ ) {
+        for ( int j = 0; j < tc; j++ ) {
+          const int m = n[i][j];
+          int dist = 0; // distance to the nearest m
+          for ( int k = 1; k <= m && !dist; k++ ) {
+            if ( (i - k >= 0 && n[i-k][j] == m) || (i + k < tr && n[i+k][j] == m) ||
+                 (j - k >= 0 && n[i][j-k] == m) || (j + k < tc && n[i][j+k] == m) ) dist = k;
+          }
+          if ( dist != m ) return false;
+        }
+      }
+      return true;
+    }
+    int sweep() // imply() by sweeping the table until nothing changes
     {
       int cntr  = 0; // total number of implications
       int delta = 0; // change in cntr;
@@ -374,89 +1240,1046 @@ struct state {
         res = z_constrain(); if ( res < 0 ) return -1;
         cntr += delta;
       } while ( delta > 0 || res > 1 );
-      cout << "result: " << cntr << endl;
+      if ( !quiet ) cout << "result: " << cntr << endl;
       return cntr;
     }
 
     void print() const { // print known/assumed values, show region boundaries
       for ( int i = 0; i < tr; i++ ) {
-        if ( !i ) cout << "------------------------------------" << endl;
+        if ( !i ) cout << string(4*tc,'-') << endl;
         for ( int j = 0; j < tc; j++ ) {
-            cout << ((!j || regs[sq2reg[i][j-1]] != regs[sq2reg[i][j]]) ? "| " : "  ");
+            cout << ((!j || reg(i,j-1) != reg(i,j)) ? "| " : "  ");
             cout << abs(n[i][j]) << ' ';
         }
         cout << endl;
-        if ( i + 1 == tr ) cout << "------------------------------------" << endl;
+        if ( i + 1 == tr ) cout << string(4*tc,'-') << endl;
         else
         for ( int j = 0; j < tc; j++ ) {
-            cout << (( regs[sq2reg[i+1][j]] != regs[sq2reg[i][j]]) ? " ---" : "    ");
+            cout << (( reg(i+1,j) != reg(i,j)) ? " ---" : "    ");
         }
         cout << endl;
       }
     }
-    void printx() const { // print excluded values
+};
+
+//******************************************************************************
+// Bitboards. A 9 x 9 table fits in 81 bits, so a set of squares can be kept
+// in two 64-bit words: square (r,c) is bit r*tc+c. Logical operations then
+// act on the whole table at once, and a shift by tc moves every square one
+// row up or down. A shift by one moves it along the row, so row wrapping has
+// to be masked out with column masks. Tables of up to 128 squares are
+// supported.
+
+constexpr int bmax = 128; // max n of table squares
+
+struct bboard {
+  uint64_t w[2];
+  bboard()                       { w[0] = 0; w[1] = 0; }
+  bboard(uint64_t lo, uint64_t hi) { w[0] = lo; w[1] = hi; }
+  static bboard sq(int q) { // single square
+    return q < 64 ? bboard(uint64_t(1) << q, 0) : bboard(0, uint64_t(1) << (q-64));
+  }
+  bool test(int q) const { return (w[q >> 6] >> (q & 63)) & 0x01; }
+  void set(int q)        { w[q >> 6] |=  uint64_t(1) << (q & 63); }
+  void reset(int q)      { w[q >> 6] &= ~(uint64_t(1) << (q & 63)); }
+  bool any() const       { return w[0] | w[1]; }
+  int count() const      { return __builtin_popcountll(w[0]) + __builtin_popcountll(w[1]); }
+  int first() const { // index of the lowest square, -1 if empty
+    if ( w[0] ) return __builtin_ctzll(w[0]);
+    if ( w[1] ) return __builtin_ctzll(w[1]) + 64;
+    return -1;
+  }
+  bboard operator|(const bboard& o) const { return bboard(w[0] | o.w[0], w[1] | o.w[1]); }
+  bboard operator&(const bboard& o) const { return bboard(w[0] & o.w[0], w[1] & o.w[1]); }
+  bboard operator~() const                { return bboard(~w[0], ~w[1]); }
+  void operator|=(const bboard& o) { w[0] |= o.w[0]; w[1] |= o.w[1]; }
+  void operator&=(const bboard& o) { w[0] &= o.w[0]; w[1] &= o.w[1]; }
+  bboard operator<<(int k) const { // square q moves to q+k
+    if ( !k )     return *this;
+    if ( k >= 64 ) return bboard(0, w[0] << (k-64));
+    return bboard(w[0] << k, (w[1] << k) | (w[0] >> (64-k)));
+  }
+  bboard operator>>(int k) const { // square q moves to q-k
+    if ( !k )     return *this;
+    if ( k >= 64 ) return bboard(w[1] >> (k-64), 0);
+    return bboard((w[0] >> k) | (w[1] << (64-k)), w[1] >> k);
+  }
+  bboard from(int q) const { return (*this >> q) << q; } // squares >= q
+};
+
+//******************************************************************************
+// Masks of rows, columns and regions of a puzzle, and the shifts built on them
+
+struct btables {
+  int tr;                 // table, number of rows
+  int tc;                 // table, number of columns
+  int nsq;                // n of table squares
+  bboard full;            // all table squares
+  vector<bboard> row;     // squares of a row
+  vector<bboard> col;     // squares of a column
+  vector<bboard> col_lt;  // squares with column < k
+  vector<bboard> col_ge;  // squares with column >= k
+  vector<bboard> reg;     // squares of a region
+  vector<int>    sq2reg;  // region of square q
+  btables(const puzzle& pz) : tr(pz.tr), tc(pz.tc), nsq(pz.tr * pz.tc),
+      row(tr), col(tc), col_lt(tc+1), col_ge(tc+1), reg(pz.regs.size()),
+      sq2reg(pz.sq2reg) {
+    assert( nsq <= bmax );
+    for ( int i = 0; i < tr; i++ ) {
+      for ( int j = 0; j < tc; j++ ) {
+        const int q = i * tc + j;
+        full.set(q);
+        row[i].set(q);
+        col[j].set(q);
+        reg[sq2reg[q]].set(q);
+        for ( int k = 0; k <= tc; k++ ) {
+          if ( j < k ) col_lt[k].set(q);
+          else         col_ge[k].set(q);
+        }
+      }
+    }
+  }
+  bboard span(int a, int b) const { // squares a..b, clipped to the table
+    if ( a < 0 )     a = 0;
+    if ( b >= nsq )  b = nsq - 1;
+    if ( a > b )     return bboard();
+    return (full >> (nsq-1 - (b-a))) << a;
+  }
+  bboard near(int q, int m) const { // squares closer than m along row/column
+    const int r = q / tc;
+    return (span(q-m+1,q+m-1) & row[r]) |
+           (span((r-m+1)*tc,(r+m)*tc-1) & col[q % tc]);
+  }
+  // squares that have a square of b exactly m away; up, down, left, right
+  bboard up   (const bboard& b, int m) const { return (b << (m*tc)) & full; }
+  bboard down (const bboard& b, int m) const { return  b >> (m*tc); }
+  bboard left (const bboard& b, int m) const { return (b << m) & col_ge[m]; }
+  bboard right(const bboard& b, int m) const { return (b >> m) & col_lt[tc-m]; }
+  bboard partner(const bboard& b, int m) const {
+    return (m < tr ? up(b,m) | down(b,m) : bboard()) |
+           (m < tc ? left(b,m) | right(b,m) : bboard());
+  }
+};
+
+//******************************************************************************
+// bstate is the state above kept as two bitboards per digit: p[k] marks
+// squares where digit k+1 is still possible (for a known square only its own
+// value), s[k] marks squares known to be k+1. constrain() then excludes a
+// digit around a square with a few whole-table operations, and the rules look
+// for candidate squares in all squares at once.
+// The rules visit candidates in the same row-major order as the loops of
+// state, so both produce the same sequence of implications as state::sweep().
+
+struct bstate {
+    const btables& bt;
+    const int tr;  // table, number of rows
+    const int tc;  // table, number of columns
+    const int nsq; // n of table squares
+    bboard p[nb]; // digit possible
+    bboard s[nb]; // digit known or assumed
+    bboard ns;    // any digit known or assumed
+    trace  events; // implications found
+    template <class S> bstate(const btables& t, const S& st)
+        : bt(t), tr(t.tr), tc(t.tc), nsq(t.nsq) {
+      for ( int i = 0; i < tr; i++ ) {
+        for ( int j = 0; j < tc; j++ ) {
+          const int q = i * tc + j;
+          const int m = st.n[i][j];
+          if ( m ) { s[m-1].set(q); p[m-1].set(q); ns.set(q); continue; }
+          for ( int k = 0; k < nb; k++ ) if ( !((st.x[i][j] >> k) & 0x01) ) p[k].set(q);
+        }
+      }
+    }
+    template <class S> void store(S& st) const { // back to n and x
       for ( int i = 0; i < tr; i++ ) {
         for ( int j = 0; j < tc; j++ ) {
-            for ( int k = 0; k < 8; k++ ) {
-//                 cout << (int)x[i][j] << endl;
-                int b = 0x01 & ( x[i][j] >> k ); 
-//                 cout << b;
-            }
-            cout << "  ";
+          const int q = i * tc + j;
+          st.n[i][j] = 0;
+          st.x[i][j] = ~0;
+          for ( int k = 0; k < nb; k++ ) {
+            if ( s[k].test(q) ) st.n[i][j] = k + 1;
+            if ( p[k].test(q) ) st.x[i][j] &= ~(0x01 << k);
+          }
         }
-        cout << endl;
       }
     }
+    bboard empty() const { return bt.full & ~ns; }
+    void messageX(int r, int c, int m) { events.add(ruleX,r,c,m); }
+    void messageR(int r, int c, int m) { events.add(ruleR,r,c,m); }
+    void messageZ(int r, int c, int m) { events.add(ruleZ,r,c,m); }
+    void messageY(int r, int c, int m) { events.add(ruleY,r,c,m); }
+    void set_n(int q, int m) {
+      const bboard sq = bboard::sq(q);
+      for ( int k = 0; k < nb; k++ ) p[k] &= ~sq;
+      p[m-1] |= sq;
+      s[m-1] |= sq;
+      ns     |= sq;
+    }
+    int digit(int q) const { // digit of a known square, or of one with a single choice
+      for ( int k = 0; k < nb; k++ ) if ( p[k].test(q) ) return k + 1;
+      return 0;
+    }
+    bool dead(const bboard& sqs) const { // any of the empty squares without choices?
+      bboard any;
+      for ( int k = 0; k < nb; k++ ) any |= p[k];
+      return (sqs & empty() & ~any).any();
+    }
+    int constrain(int q) {
+      // see state::constrain, q = r*tc+c
+      const int    m    = digit(q);
+      const bboard near = (bt.near(q,m) | bt.reg[bt.sq2reg[q]]) & ~bboard::sq(q);
+      if ( (near & s[m-1]).any() ) return -1; // same value too close
+      p[m-1] &= ~near;
+      return dead(near) ? -1 : 1;
+    }
+    int x_imply() { // apply all possible x implications
+      int cntr = 0;
+      for ( int q = 0; ; q++ ) {
+        bboard one, two; // squares with at least one, two choices
+        for ( int k = 0; k < nb; k++ ) { two |= one & p[k]; one |= p[k]; }
+        q = (empty() & ~two).from(q).first();
+        if ( q < 0 ) break;
+        if ( !one.test(q) ) return -1; // all choices excluded
+        const int m = digit(q);
+        set_n(q,m);
+        messageX(q / tc, q % tc, m);
+        if ( constrain(q) < 0 ) return -1;
+        cntr++;
+      }
+      return cntr;
+    }
+    int r_imply() { // apply all possible r implications
+      int cntr = 0;
+      for ( int q = 0; ; q++ ) {
+        bboard u; // squares holding the only place for a digit in their region
+        for ( int k = 0; k < nb; k++ ) {
+          for ( const auto& g : bt.reg ) {
+            const bboard t = p[k] & g;
+            if ( t.count() == 1 ) u |= t;
+          }
+        }
+        q = (u & empty()).from(q).first();
+        if ( q < 0 ) break;
+        const bboard& g = bt.reg[bt.sq2reg[q]];
+        int m = 0;
+        for ( int k = 0; k < nb; k++ ) {
+          if ( !p[k].test(q) || (p[k] & g).count() != 1 ) continue;
+          if ( m ) return -1; // two values possible only at q
+          m = k + 1;
+        }
+        messageR(q / tc, q % tc, m);
+        set_n(q,m);
+        cntr++;
+      }
+      return cntr;
+    }
+    int z_imply() { // apply all possible z implications
+      int cntr = 0;
+      for ( int q = 0; ; q++ ) {
+        int src = -1; // first known square with a single way to satisfy distance
+        int m   = 0;
+        for ( int k = 1; k <= nb; k++ ) {
+          if ( !s[k-1].any() ) continue;
+          const bboard c = p[k-1] & empty(); // candidate squares
+          const bboard d[4] = { k < tr ? bt.up(c,k)    : bboard(),
+                                k < tr ? bt.down(c,k)  : bboard(),
+                                k < tc ? bt.left(c,k)  : bboard(),
+                                k < tc ? bt.right(c,k) : bboard() };
+          bboard one, two;
+          for ( const auto& e : d ) { two |= one & e; one |= e; }
+          const int f = (s[k-1] & ~bt.partner(s[k-1],k) & one & ~two).from(q).first();
+          if ( f >= 0 && (src < 0 || f < src) ) { src = f; m = k; }
+        }
+        if ( src < 0 ) break;
+        q = src;
+        const bboard c = p[m-1] & empty();
+        int t;
+        if      ( q - m*tc >= 0  && c.test(q - m*tc) ) t = q - m*tc;
+        else if ( q + m*tc < nsq && c.test(q + m*tc) ) t = q + m*tc;
+        else if ( q % tc - m >= 0 && c.test(q - m) )   t = q - m;
+        else                                           t = q + m;
+        messageZ(t / tc, t % tc, m);
+        set_n(t,m);
+        if ( constrain(t) < 0 ) return -1;
+        cntr++;
+      }
+      return cntr;
+    }
+    int z_constrain() { // apply all possible z constraints
+      bboard d[nb]; // squares where a digit cannot reach its min distance
+      for ( int k = 0; k < nb; k++ ) d[k] = p[k] & empty() & ~bt.partner(p[k],k+1);
+      int cntr = 0;
+      int q    = 0; // square and digit index to continue from
+      int k0   = 0;
+      while ( true ) {
+        int f = -1;
+        int m = 0;
+        for ( int k = 0; k < nb; k++ ) {
+          int e = d[k].from(k < k0 ? q+1 : q).first();
+          if ( e >= 0 && (f < 0 || e < f) ) { f = e; m = k + 1; }
+        }
+        if ( f < 0 ) break;
+        messageY(f / tc, f % tc, m);
+        p[m-1].reset(f);
+        if ( dead(bboard::sq(f)) ) return -1;
+        cntr++;
+        d[m-1] = p[m-1] & empty() & ~bt.partner(p[m-1],m);
+        q  = f;
+        k0 = m;
+      }
+      return cntr;
+    }
+    int imply() // find all possible implications and constraints
+    {
+      int cntr  = 0; // total number of implications
+      int delta = 0; // change in cntr;
+      int res   = 0; // partial result
+      do {
+        delta = 0;
+        res = x_imply(); if ( res < 0 ) return -1; delta += res;
+        res = r_imply(); if ( res < 0 ) return -1; delta += res;
+        res = z_imply(); if ( res < 0 ) return -1; delta += res;
+        res = z_constrain(); if ( res < 0 ) return -1;
+        cntr += delta;
+      } while ( delta > 0 || res > 1 );
+      if ( !quiet ) cout << "result: " << cntr << endl;
+      return cntr;
+    }
+};
+
+//******************************************************************************
+// Lockstep propagation of many puzzles on the same table. The state is bit
+// sliced: bit l of a lane word belongs to puzzle l, p[q*nb+k] has the
+// puzzles where digit k+1 is still possible at square q, s[q*nb+k] those
+// where q is known to be k+1. Each rule is then a few logical operations on
+// lane words and acts on all puzzles at once. The rules are constrain(), X,
+// R, Z and Y of state, applied by sweeps until no puzzle changes; M is left
+// out. A lane word has 64 lanes, or 256 when compiled for AVX2 (the loops
+// over its words are vectorized).
+
+#ifdef __AVX2__
+constexpr int nlw = 4; // 64-bit words per lane word
+#else
+constexpr int nlw = 1;
+#endif
+
+struct lword {
+  uint64_t w[nlw];
+  lword()                         { for ( int i = 0; i < nlw; i++ ) w[i] = 0; }
+  static lword lanes(int n) { // lanes 0..n-1
+    lword r;
+    for ( int i = 0; i < nlw; i++ ) {
+      const int k = n - 64*i;
+      r.w[i] = k >= 64 ? ~uint64_t(0) : k > 0 ? (uint64_t(1) << k) - 1 : 0;
+    }
+    return r;
+  }
+  bool test(int l) const { return (w[l >> 6] >> (l & 63)) & 0x01; }
+  void set(int l)        { w[l >> 6] |= uint64_t(1) << (l & 63); }
+  bool any() const {
+    uint64_t a = 0;
+    for ( int i = 0; i < nlw; i++ ) a |= w[i];
+    return a;
+  }
+  lword operator|(const lword& o) const { lword r; for ( int i = 0; i < nlw; i++ ) r.w[i] = w[i] | o.w[i]; return r; }
+  lword operator&(const lword& o) const { lword r; for ( int i = 0; i < nlw; i++ ) r.w[i] = w[i] & o.w[i]; return r; }
+  lword operator~() const               { lword r; for ( int i = 0; i < nlw; i++ ) r.w[i] = ~w[i]; return r; }
+  void operator|=(const lword& o) { for ( int i = 0; i < nlw; i++ ) w[i] |= o.w[i]; }
+  void operator&=(const lword& o) { for ( int i = 0; i < nlw; i++ ) w[i] &= o.w[i]; }
 };
 
-void init_regs()
-{
-  regs.resize(20);
-  for ( int i = 0; i < tr; i++ ) {
-    for ( int j = 0; j < tc; j++ ) {
-        regs[sq2reg[i][j]].emplace_back(i,j);
+struct lockstep {
+  static constexpr int nl = 64 * nlw; // n of lanes
+  const puzzle& pz;     // the table, shared by all lanes
+  const int     nsq;    // n of table squares
+  vector<lword> p;      // digit possible
+  vector<lword> s;      // digit known
+  vector<lword> known;  // square known, any digit
+  vector<lword> fresh;  // square known, not yet constrained around
+  lword         used;   // lanes holding a puzzle
+  lword         bad;    // lanes in conflict
+  lword         moved;  // lanes changed by the current sweep
+  lockstep(const puzzle& t) : pz(t), nsq(t.tr * t.tc), p(nsq*nb), s(nsq*nb), known(nsq), fresh(nsq) {
+    assert( pz.nv <= nb );
+  }
+  void load(int l, const vector<int>& clues) { // the clues of the puzzle of lane l
+    used.set(l);
+    for ( int q = 0; q < nsq; q++ ) {
+      for ( int k = 0; k < pz.rsize[q]; k++ ) if ( !clues[q] || clues[q] == k+1 ) p[q*nb+k].set(l);
+      if ( clues[q] ) { s[q*nb+clues[q]-1].set(l); known[q].set(l); fresh[q].set(l); }
     }
   }
-}
+  // Lanes in conflict are left as they are, so each lane goes its own way
+  // whatever the others do.
+  void set(int q, int k, lword l) { // square q is k+1 in lanes l
+    l &= ~bad;
+    if ( !l.any() ) return;
+    s[q*nb+k] |= l;
+    known[q]  |= l;
+    fresh[q]  |= l;
+    for ( int j = 0; j < nb; j++ ) if ( j != k ) p[q*nb+j] &= ~l;
+    moved |= l;
+  }
+  void exclude(int q, int k, const lword& l) { // digit k+1 not at q in lanes l
+    const lword e = p[q*nb+k] & l & ~bad;
+    if ( !e.any() ) return;
+    p[q*nb+k] &= ~e;
+    moved |= e;
+  }
+  int ray(int q, int d, int k) const { // square k+1 away from q in direction d, -1 if none
+    return k < pz.rlen[q*4+d] ? pz.ray[(q*4+d)*pz.nv+k] : -1;
+  }
+  void constrain() {
+    // excludes known values closer than their value along rows and columns,
+    // and elsewhere in their region; the same value there is a conflict.
+    // Once for each square and lane.
+    for ( int q = 0; q < nsq; q++ ) {
+      if ( !fresh[q].any() ) continue;
+      const lword f = fresh[q];
+      fresh[q] = lword();
+      for ( int k = 0; k < pz.rsize[q]; k++ ) {
+        const lword v = s[q*nb+k] & f;
+        if ( !v.any() ) continue;
+        auto near = [&](int r) { bad |= v & s[r*nb+k]; exclude(r,k,v & ~known[r]); };
+        for ( int d = 0; d < 4; d++ ) {
+          for ( int j = 0; j < k; j++ ) { const int r = ray(q,d,j); if ( r < 0 ) break; near(r); }
+        }
+        const int g = pz.sq2reg[q];
+        for ( int i = pz.rfirst[g]; i < pz.rfirst[g+1]; i++ ) if ( pz.rsq[i] != q ) near(pz.rsq[i]);
+      }
+    }
+  }
+  void x_imply() { // the only value left; none or two known values is a conflict
+    for ( int q = 0; q < nsq; q++ ) {
+      if ( !(used & ~known[q]).any() ) continue; // known in all lanes
+      lword one, two, sone, stwo;
+      for ( int k = 0; k < nb; k++ ) {
+        two  |= one & p[q*nb+k];  one  |= p[q*nb+k];
+        stwo |= sone & s[q*nb+k]; sone |= s[q*nb+k];
+      }
+      bad |= (used & ~one) | stwo;
+      const lword single = one & ~two & ~known[q];
+      if ( !single.any() ) continue;
+      for ( int k = 0; k < nb; k++ ) set(q,k,single & p[q*nb+k]);
+    }
+  }
+  void r_imply() { // the only square of its region for a value
+    for ( size_t g = 0; g + 1 < pz.rfirst.size(); g++ ) {
+      const int* b  = pz.rsq.data() + pz.rfirst[g];
+      const int  ss = pz.rfirst[g+1] - pz.rfirst[g];
+      for ( int k = 0; k < ss; k++ ) {
+        lword one, two;
+        for ( int i = 0; i < ss; i++ ) { two |= one & p[b[i]*nb+k]; one |= p[b[i]*nb+k]; }
+        bad |= used & ~one;
+        const lword only = one & ~two;
+        if ( !only.any() ) continue;
+        for ( int i = 0; i < ss; i++ ) set(b[i],k,only & p[b[i]*nb+k] & ~known[b[i]]);
+      }
+    }
+  }
+  void z_imply() {
+    // the only square where a known value can have its partner; no such
+    // square is a conflict
+    for ( int q = 0; q < nsq; q++ ) {
+      for ( int k = 0; k < pz.rsize[q]; k++ ) {
+        const lword v = s[q*nb+k];
+        if ( !v.any() ) continue;
+        lword met, one, two, opt[4];
+        for ( int d = 0; d < 4; d++ ) {
+          const int r = ray(q,d,k);
+          if ( r < 0 ) continue;
+          met   |= s[r*nb+k];
+          opt[d] = p[r*nb+k] & ~known[r];
+          two   |= one & opt[d]; one |= opt[d];
+        }
+        bad |= v & ~met & ~one;
+        const lword only = v & ~met & one & ~two;
+        if ( !only.any() ) continue;
+        for ( int d = 0; d < 4; d++ ) if ( ray(q,d,k) >= 0 ) set(ray(q,d,k),k,only & opt[d]);
+      }
+    }
+  }
+  void z_constrain() { // a value without a square for its partner is excluded
+    for ( int q = 0; q < nsq; q++ ) {
+      if ( !(used & ~known[q] & ~bad).any() ) continue;
+      for ( int k = 0; k < pz.rsize[q]; k++ ) {
+        lword reach;
+        for ( int d = 0; d < 4; d++ ) { const int r = ray(q,d,k); if ( r >= 0 ) reach |= p[r*nb+k]; }
+        exclude(q,k,~known[q] & ~reach);
+      }
+    }
+  }
+  int imply() { // sweeps until no lane changes; returns the n of sweeps
+    int n = 0;
+    do {
+      moved = lword();
+      constrain();
+      x_imply();
+      r_imply();
+      z_imply();
+      z_constrain();
+      n++;
+    } while ( (moved & used & ~bad).any() );
+    return n;
+  }
+  int value(int l, int q) const { // of square q in lane l, 0 if unknown
+    for ( int k = 0; k < nb; k++ ) if ( s[q*nb+k].test(l) ) return k + 1;
+    return 0;
+  }
+};
 
-int sum( const state& st) {
+template <class S> int sum( const S& st) {
   int sig = 0;
-  for ( auto sh : regs ) {
+  for ( auto sh : st.pz->regs ) {
     int max = 0;
     for ( auto e : sh ) {
       int s = 0;
       int i = e.first;
       int j = e.second;
-      while ( j && sq2reg[i,j-1] == sq2reg[i,j] ) j--; 
+      while ( j && st.reg(i,j-1) == st.reg(i,j) ) j--; 
       do {
         s *= 10;
         s += st.n[i][j];
-        //cout << "loop - reg: " << sq2reg[i][j] << " i: " << i << " j: " << j << " s: " << s << " sh': " << sq2reg[i][j+1] << endl; 
         j++;
-        //cout << "loop - reg: " << sq2reg[i][j-1] << " -> " << sq2reg[i][j] << endl; 
-        //cout << "loop - reg: " << (sq2reg[i][j-1] == sq2reg[i][j]) << endl; 
-        //cout << "loop - cond:  " << (j < tc) << " " << ( sq2reg[i,j-1] == sq2reg[i,j] ) << " " << (j <  tc && sq2reg[i,j-1] == sq2reg[i,j]) << endl;
       }
-      while ( j <  tc && sq2reg[i][j-1] == sq2reg[i][j] );
+      while ( j <  st.tc && st.reg(i,j-1) == st.reg(i,j) );
       s = abs(s);
       if ( s > max ) max = s;
     }
-    cout << "max: " << max << endl;
+    if ( !quiet ) cout << "max: " << max << endl;
     sig += max;
   }
-  cout << "SIG: " << sig << endl;
+  if ( !quiet ) cout << "SIG: " << sig << endl;
+  return sig;
 }
 
-int main(int argc, char **argv) {
+//******************************************************************************
+// Counting solutions. The search tree is split among threads. A worker
+// explores its subtree depth first, undoing through the trail; when another
+// worker is idle, it hands the untried values of its current square over as
+// a task (a copy of the state, the square and the values left). Each worker
+// takes its own newest task first and steals the oldest task of another
+// worker, i.e. the largest subtree, when it has none.
+// The count stops at limit, so limit 2 answers "is the solution unique?".
+
+template <int TR, int TC, class M = mark_t> struct counter {
+  typedef state<TR,TC,M> state_t;
+  typedef M              mark_t;
+  struct task { // values to try at a square, with the state before them
+    state_t st;
+    int     r, c; // square, r < 0 to search the state
+    mark_t  vals; // values to try
+  };
+  struct tasks { mutex m; deque<unique_ptr<task>> q; };
+  const long           limit;   // stop at this many solutions, 0 = count all
+  atomic<long>         found;   // solutions found
+  atomic<long>         pending; // tasks queued or running
+  atomic<int>          idle;    // workers without a task
+  atomic<bool>         stop;    // limit reached
+  int                  nw = 0;  // n of workers
+  unique_ptr<tasks[]>  dq;      // tasks of each worker
+  counter(long lim) : limit(lim), found(0), pending(0), idle(0), stop(false) {}
+  long run(const state_t& root, int nthreads) {
+    nw = max(nthreads,1);
+    dq.reset(new tasks[nw]);
+    pending = 1;
+    dq[0].q.emplace_back(new task{root,-1,-1,0});
+    vector<thread> threads;
+    for ( int k = 0; k < nw; k++ ) threads.emplace_back(&counter::worker,this,k);
+    for ( auto& t : threads ) t.join();
+    return found;
+  }
+  unique_ptr<task> take(int id) { // own newest task, or the oldest of another
+    for ( int k = 0; k < nw; k++ ) {
+      tasks& d = dq[(id + k) % nw];
+      lock_guard<mutex> lk(d.m);
+      if ( d.q.empty() ) continue;
+      unique_ptr<task> t;
+      if ( !k ) { t = move(d.q.back());  d.q.pop_back();  }
+      else      { t = move(d.q.front()); d.q.pop_front(); }
+      return t;
+    }
+    return nullptr;
+  }
+  void worker(int id) {
+    bool waiting = false;
+    while ( !stop && pending > 0 ) {
+      unique_ptr<task> t = take(id);
+      if ( !t ) {
+        if ( !waiting ) { idle++; waiting = true; }
+        this_thread::yield();
+        continue;
+      }
+      if ( waiting ) { idle--; waiting = false; }
+      t->st.events.disable();
+      if ( t->r < 0 ) dfs(id,t->st);
+      else            expand(id,t->st,t->r,t->c,t->vals);
+      pending--;
+    }
+    if ( waiting ) idle--;
+  }
+  void dfs(int id, state_t& st) {
+    int r, c;
+    if ( stop ) return;
+    if ( !st.pick(r,c) ) { // all squares known
+      if ( st.valid() && ++found >= limit && limit ) stop = true;
+      return;
+    }
+    expand(id,st,r,c,st.values(r,c));
+  }
+  void expand(int id, state_t& st, int r, int c, mark_t vals) {
+    const size_t mark = st.trail.size();
+    for ( int m = 1; vals && !stop; m++ ) {
+      const mark_t bit = state_t::bit(m);
+      if ( !(vals & bit) ) continue;
+      vals &= ~bit;
+      if ( vals && idle > 0 ) { // hand the other values over
+        pending++;
+        lock_guard<mutex> lk(dq[id].m);
+        dq[id].q.emplace_back(new task{st,r,c,vals});
+        vals = 0;
+      }
+      st.set_n(r,c,m);
+      if ( st.constrain(r,c) > 0 && st.propagate() >= 0 ) dfs(id,st);
+      st.clear_work();
+      st.undo(mark);
+    }
+  }
+};
+
+//******************************************************************************
+// Editing. An editor keeps the propagated state of a puzzle while clues are
+// put in and taken out, e.g. by a puzzle design tool. add() sets the clue
+// and propagates from it. remove() retracts only what follows from the
+// clue: walking the trail on from the clue, a change is dropped if its rule
+// read (state::reads()) a square changed by the clue or by a dropped change.
+// The trail is undone to the clue and the other changes are put back; the
+// squares the dropped changes had changed are scheduled again, as what they
+// implied may follow another way. Each edit reports the squares that got or
+// lost a value and the solutions left, counted up to a limit.
+
+template <int TR, int TC, class M = mark_t> struct editor {
+  typedef state<TR,TC,M>            state_t;
+  typedef typename state_t::change  change;
+  typedef chrono::steady_clock      clk;
+  struct report {
+    int         status = 0;    // 1 = done, 0 = nothing to do, -1 = conflict (not done)
+    vector<int> decided;       // squares that got a value
+    vector<int> released;      // squares that lost their value
+    long        solutions = 0; // up to limit
+    double      us = 0;        // time of the edit, microseconds
+  };
+  const long  limit;    // count solutions up to this, 0 = all, < 0 = none
+  const int   nthreads; // for the count
+  puzzle      pz;       // the table, clues are edits
+  state_t     st;       // propagated
+  vector<int> clue;     // value of the clue at q, 0 if none
+  editor(const puzzle& p, long lim, int nth) : limit(lim), nthreads(nth), pz(blank(p)),
+                                               st(pz), clue(p.tr*p.tc,0) {
+    st.events.disable();
+    st.imply();
+    for ( int q = 0; q < pz.tr*pz.tc; q++ ) if ( p.known[q] ) put(q,p.known[q]);
+  }
+  editor(const editor&) = delete; // st points to pz
+  static puzzle blank(puzzle p) { fill(p.known.begin(),p.known.end(),0); return p; }
+  report add(int r, int c, int m)  { return edit([=]() { return put(r*pz.tc+c,m); }); }
+  report remove(int r, int c)      { return edit([=]() { return take(r*pz.tc+c); }); }
+  report edit(function<int()> f) { // f() with its report
+    const auto   t0 = clk::now();
+    const vector<numb_t> before(st.n[0],st.n[0] + pz.tr*pz.tc);
+    report rep;
+    rep.status = f();
+    for ( int q = 0; q < pz.tr*pz.tc; q++ ) {
+      if ( !before[q] && st.n[0][q] ) rep.decided.push_back(q);
+      if ( before[q] && !st.n[0][q] ) rep.released.push_back(q);
+    }
+    if ( limit >= 0 ) {
+      counter<TR,TC,M> cnt(limit);
+      rep.solutions = cnt.run(st,nthreads);
+    }
+    rep.us = chrono::duration<double,micro>(clk::now() - t0).count();
+    return rep;
+  }
+  vector<int> check() const {
+    // squares whose n or x differ from those of the clues propagated anew;
+    // none if the clues have a solution (without, the point where
+    // propagation finds no conflict may depend on the order of the edits)
+    puzzle p = pz;
+    p.known = clue;
+    const editor fresh(p,-1,1);
+    vector<int> diff;
+    for ( int q = 0; q < pz.tr*pz.tc; q++ )
+      if ( fresh.st.n[0][q] != st.n[0][q] || fresh.st.x[0][q] != st.x[0][q] ) diff.push_back(q);
+    return diff;
+  }
+  int put(int q, int m) {
+    // sets a clue
+    // return : 1 = set
+    //          0 = the same clue is there
+    //         -1 = conflict with the clues, or another clue there
+    if ( m < 1 || m > pz.rsize[q] ) return -1;
+    if ( clue[q] ) return clue[q] == m ? 0 : -1;
+    const int    r = q / pz.tc, c = q % pz.tc;
+    const size_t mark = st.trail.size();
+    st.because(state_t::byDecision,r,c);
+    if ( st.n[r][c] == m ) st.save(q); // implied already, kept by the clue now
+    else if ( st.n[r][c] || (st.x[r][c] & state_t::bit(m)) ) return -1;
+    else st.set_n(r,c,m);
+    if ( st.constrain(r,c) < 0 || st.propagate() < 0 ) {
+      st.clear_work();
+      st.undo(mark);
+      return -1;
+    }
+    clue[q] = m;
+    return 1;
+  }
+  int take(int q) {
+    // removes a clue
+    // return : 1 = removed
+    //          0 = no clue there
+    //         -1 = conflict with the other clues (not removed)
+    if ( !clue[q] ) return 0;
+    const int    nsq = pz.tr*pz.tc;
+    vector<change>& t = st.trail;
+    size_t k0 = t.size(); // the clue
+    while ( k0-- > 0 ) if ( t[k0].by == state_t::byDecision && t[k0].at == q ) break;
+    assert( k0 < t.size() );
+    // n and x after each change: before the next change of its square
+    vector<numb_t> an(t.size()), cn(st.n[0],st.n[0] + nsq);
+    vector<M>      ax(t.size()), cx(st.x[0],st.x[0] + nsq);
+    for ( size_t k = t.size(); k-- > k0; ) {
+      an[k] = cn[t[k].q]; cn[t[k].q] = t[k].n;
+      ax[k] = cx[t[k].q]; cx[t[k].q] = t[k].x;
+    }
+    vector<char> bad(nsq,false); // changed by the clue or a dropped change
+    vector<char> drop(t.size(),false);
+    bad[q] = drop[k0] = true;
+    for ( size_t k = k0 + 1; k < t.size(); k++ ) {
+      if ( t[k].by == state_t::byDecision ) { bad[t[k].q] = false; continue; } // a clue sets all
+      bool d = false;
+      st.reads(t[k],[&bad,&d](int p) { d = d || bad[p]; });
+      if ( d ) bad[t[k].q] = drop[k] = true;
+    }
+    const vector<change> old(t.begin() + k0,t.end());
+    auto restore = [&]() { // the trail and state before the removal
+      st.clear_work();
+      st.undo(k0);
+      for ( size_t k = 0; k < old.size(); k++ ) {
+        const change& e = old[k];
+        st.by = e.by; st.at = e.at; st.bym = e.m;
+        st.save(e.q);
+        st.n[0][e.q] = an[k0+k];
+        st.x[0][e.q] = ax[k0+k];
+      }
+      clue[q] = st.n[0][q];
+      return -1;
+    };
+    st.undo(k0);
+    for ( size_t k = 1; k < old.size(); k++ ) { // put the kept changes back
+      if ( drop[k0+k] ) continue;
+      const change& e = old[k];
+      st.by = e.by; st.at = e.at; st.bym = e.m;
+      st.save(e.q);
+      if ( e.by == state_t::byDecision ) { st.n[0][e.q] = an[k0+k]; st.x[0][e.q] |= ax[k0+k]; }
+      else {
+        if ( an[k0+k] != e.n ) st.n[0][e.q] = an[k0+k];
+        st.x[0][e.q] |= ax[k0+k] & ~e.x;
+      }
+    }
+    clue[q] = 0;
+    // a dropped change may have carried exclusions that a known square's
+    // constrain() would make too; apply again those that reach a bad square
+    vector<char> again(nsq,false);
+    for ( int p = 0; p < nsq; p++ ) {
+      if ( !bad[p] ) continue;
+      for ( int s : st.region(p / pz.tc,p % pz.tc) ) again[s] = true;
+      for ( int d = 0; d < 4; d++ ) {
+        const auto ry = st.ray(p,d,pz.nv);
+        for ( int k = 0; k < ry.size(); k++ )
+          if ( st.n[0][ry[k]] > k + 1 ) again[ry[k]] = true; // p within n-1 of it
+      }
+    }
+    for ( int s = 0; s < nsq; s++ )
+      if ( again[s] && st.n[0][s] && st.constrain(s / pz.tc,s % pz.tc) < 0 ) return restore();
+    for ( int p = 0; p < nsq; p++ ) if ( bad[p] ) st.touch(p);
+    // fewer clues, a conflict only if the clues had no solution and
+    // propagating in another order finds it
+    return st.propagate() < 0 ? restore() : 1;
+  }
+};
+
+//******************************************************************************
+// Generator. Random partitions are rarely solvable, so the table and its
+// filling are built together: start from 1x1 regions, all 1 (a valid
+// filling), and repeatedly split the regions near a random square anew and
+// refill them by a search that tries values in random order. A change is
+// kept if the refill succeeds. The filled values start
+// as clues; they are removed in random order as long as the solution stays
+// unique, so every clue left is needed. Random clues can be put back up to
+// a given density. Each puzzle is labelled by tier: "imply" if implications
+// alone solve it, "search" if trials are needed.
+// Random numbers come from seed_seq and mt19937 only (no std distributions),
+// so a seed gives the same corpus everywhere.
+
+inline int rnd(mt19937& rng, int n) { return rng() % n; } // 0..n-1
+
+template <class T> void rnd_shuffle(vector<T>& v, mt19937& rng) {
+  for ( int i = int(v.size()) - 1; i > 0; i-- ) swap(v[i],v[rnd(rng,i+1)]);
+}
+
+template <int TR, int TC>
+bool gen_fill(state<TR,TC>& st, mt19937& rng, long& budget) {
+  // search with values in random order; gives up after budget nodes
+  int r, c;
+  if ( --budget < 0 ) return false;
+  if ( !st.pick(r,c) ) return st.valid();
+  vector<int> vals;
+  for ( int m = 1; m <= nb; m++ ) if ( (st.values(r,c) >> (m-1)) & 0x01 ) vals.push_back(m);
+  rnd_shuffle(vals,rng);
+  const size_t mark = st.trail.size();
+  for ( int m : vals ) {
+    st.set_n(r,c,m);
+    if ( st.constrain(r,c) > 0 && st.propagate() >= 0 && gen_fill(st,rng,budget) ) return true;
+    st.clear_work();
+    st.undo(mark);
+  }
+  return false;
+}
+
+void gen_regions(puzzle& pz, mt19937& rng) {
+  // splits the squares without region (sq2reg < 0) into random regions
+  // of 1 to nb squares
+  const int tr = pz.tr, tc = pz.tc;
+  vector<int> order(tr*tc);
+  for ( int q = 0; q < tr*tc; q++ ) order[q] = q;
+  rnd_shuffle(order,rng);
+  int nreg = *max_element(pz.sq2reg.begin(),pz.sq2reg.end()) + 1;
+  for ( int q0 : order ) { // grow a region from each free square
+    if ( pz.sq2reg[q0] >= 0 ) continue;
+    const size_t size = 1 + rnd(rng,1 + rnd(rng,nb)); // small ones fit more often
+    vector<int>  sqs(1,q0);
+    pz.sq2reg[q0] = nreg;
+    while ( sqs.size() < size ) {
+      vector<int> free; // free neighbours of the region
+      for ( int q : sqs ) {
+        const int r = q / tc, c = q % tc;
+        if ( r > 0      && pz.sq2reg[q-tc] < 0 ) free.push_back(q-tc);
+        if ( r + 1 < tr && pz.sq2reg[q+tc] < 0 ) free.push_back(q+tc);
+        if ( c > 0      && pz.sq2reg[q-1]  < 0 ) free.push_back(q-1);
+        if ( c + 1 < tc && pz.sq2reg[q+1]  < 0 ) free.push_back(q+1);
+      }
+      if ( free.empty() ) break;
+      const int q = free[rnd(rng,free.size())];
+      pz.sq2reg[q] = nreg;
+      sqs.push_back(q);
+    }
+    nreg++;
+  }
+}
+
+template <int TR, int TC>
+puzzle gen_solved(int tr, int tc, mt19937& rng) {
+  // a random partition with its filling in known
+  puzzle pz;
+  pz.tr = tr;
+  pz.tc = tc;
+  pz.known.assign(tr*tc,1);
+  for ( int q = 0; q < tr*tc; q++ ) pz.sq2reg.push_back(q);
+  for ( int step = 0; step < 20*tr*tc; step++ ) {
+    // splits the regions near a random square anew and refills them
+    const int r = rnd(rng,tr), c = rnd(rng,tc);
+    puzzle next = pz;
+    vector<bool> near(*max_element(pz.sq2reg.begin(),pz.sq2reg.end()) + 1,false); // regions near (r,c)
+    for ( int q = 0; q < tr*tc; q++ ) {
+      if ( abs(q / tc - r) + abs(q % tc - c) <= 2 ) near[pz.sq2reg[q]] = true;
+    }
+    for ( int q = 0; q < tr*tc; q++ ) {
+      if ( near[pz.sq2reg[q]] ) { next.sq2reg[q] = -1; next.known[q] = 0; }
+    }
+    gen_regions(next,rng);
+    next.init_regs();
+    state<TR,TC> st(next);
+    st.events.disable();
+    bool ok = true;
+    for ( int i = 0; i < tr && ok; i++ ) {
+      for ( int j = 0; j < tc && ok; j++ ) ok = !st.n[i][j] || st.constrain(i,j) > 0;
+    }
+    long budget = 1000;
+    if ( !ok || st.propagate() < 0 || !gen_fill(st,rng,budget) ) continue;
+    for ( int q = 0; q < tr*tc; q++ ) next.known[q] = st.n[q / tc][q % tc];
+    pz = next;
+  }
+  vector<int> ids; // renumber regions by appearance
+  for ( auto& s : pz.sq2reg ) {
+    const int id = s;
+    s = find(ids.begin(),ids.end(),id) - ids.begin();
+    if ( s == (int)ids.size() ) ids.push_back(id);
+  }
+  pz.init_regs();
+  return pz;
+}
+
+template <int TR, int TC>
+long gen_count(state<TR,TC>& st, long limit, long& budget) {
+  // as counter::run(), but gives up (returns limit) after budget nodes
+  int r, c;
+  if ( --budget < 0 ) return limit;
+  if ( !st.pick(r,c) ) return st.valid();
+  long cntr = 0;
+  const size_t mark = st.trail.size();
+  for ( int m = 1; m <= nb; m++ ) {
+    if ( !((st.values(r,c) >> (m-1)) & 0x01) ) continue;
+    st.set_n(r,c,m);
+    if ( st.constrain(r,c) > 0 && st.propagate() >= 0 ) cntr += gen_count(st,limit - cntr,budget);
+    st.clear_work();
+    st.undo(mark);
+    if ( cntr >= limit ) break;
+  }
+  return cntr;
+}
+
+template <int TR, int TC>
+int gen_check(const puzzle& pz, long limit, bool& implied) {
+  // n of solutions up to limit, limit if not found in time;
+  // implied -- imply() alone solves the puzzle
+  state<TR,TC> st(pz);
+  st.events.disable();
+  implied = false;
+  for ( int i = 0; i < st.tr; i++ ) {
+    for ( int j = 0; j < st.tc; j++ ) {
+      if ( st.n[i][j] && st.constrain(i,j) < 0 ) return 0;
+    }
+  }
+  if ( st.imply() < 0 ) return 0;
+  int r, c;
+  implied = !st.pick(r,c) && st.valid();
+  long budget = 100 * pz.tr * pz.tc;
+  return gen_count(st,limit,budget);
+}
+
+template <int TR, int TC>
+puzzle generate(int tr, int tc, double density, mt19937& rng, bool& implied) {
+  puzzle pz = gen_solved<TR,TC>(tr,tc,rng);
+  const vector<int> fill = pz.known;
+  vector<int> order(tr*tc);
+  for ( int q = 0; q < tr*tc; q++ ) order[q] = q;
+  rnd_shuffle(order,rng);
+  for ( int q : order ) { // remove clues not needed for uniqueness
+    pz.known[q] = 0;
+    if ( gen_check<TR,TC>(pz,2,implied) != 1 ) pz.known[q] = fill[q];
+  }
+  rnd_shuffle(order,rng);
+  int clues = 0;
+  for ( int q = 0; q < tr*tc; q++ ) clues += pz.known[q] > 0;
+  for ( int q : order ) { // put clues back up to density
+    if ( clues >= density * tr * tc ) break;
+    if ( !pz.known[q] ) { pz.known[q] = fill[q]; clues++; }
+  }
+  gen_check<TR,TC>(pz,1,implied);
+  return pz;
+}
+
+int gen_corpus(unsigned seed, int n, int size) {
+  // n puzzles for each table size and clue density;
+  // sizes 7x7, 9x9 and 11x11 if size == 0, else size x size
+  vector<int>  sizes = { 7, 9, 11 };
+  const double densities[] = { 0, 0.3, 0.5 }; // 0 -- minimal clues
+  if ( size ) sizes.assign(1,size);
+  for ( int s : sizes ) {
+    for ( double d : densities ) {
+      for ( int k = 0; k < n; k++ ) {
+        seed_seq seq = { seed, unsigned(s), unsigned(d * 10), unsigned(k) };
+        mt19937  rng(seq); // a stream per puzzle
+        bool implied;
+        puzzle pz;
+        if      ( s ==  7 ) pz = generate< 7, 7>(s,s,d,rng,implied);
+        else if ( s ==  9 ) pz = generate< 9, 9>(s,s,d,rng,implied);
+        else if ( s == 11 ) pz = generate<11,11>(s,s,d,rng,implied);
+        else                pz = generate< 0, 0>(s,s,d,rng,implied);
+        int clues = 0;
+        for ( int v : pz.known ) clues += v > 0;
+        cout << "# " << s << 'x' << s << " seed " << seed << " density " << d
+             << " no " << k << " clues " << clues
+             << " tier " << (implied ? "imply" : "search") << '\n';
+        pz.write(cout);
+      }
+    }
+  }
+  return 0;
+}
+
+//******************************************************************************
+// Benchmark. Times the phases of solving a puzzle -- building the state, the
+// initial constraints, the implications, the trials for the squares they
+// leave open, and the answer (sum) -- over reps
+// repetitions and prints the median, the 99th percentile and squares per
+// second of each. Every repetition checks its result: knownH and answerH for
+// the built-in puzzle, a valid filling for others. A wrong result stops the
+// run with exit code 1, so a change to the engine cannot slip through.
+
+template <int TR, int TC, class M = mark_t> int bench(const puzzle& pz, int reps, bool golden) {
+  typedef chrono::steady_clock clk;
+  const int      nph = 5;
+  const char*    phase[nph] = { "state", "constrain", "imply", "search", "sum" };
+  vector<double> t[nph]; // ns per repetition
+  for ( int k = 0; k < reps; k++ ) {
+    const auto t0 = clk::now();
+    state<TR,TC,M> st(pz);
+    st.events.disable();
+    const auto t1 = clk::now();
+    bool ok = true;
+    for ( int i = 0; i < st.tr; i++ ) {
+      for ( int j = 0; j < st.tc; j++ ) {
+        if ( st.n[i][j] && st.constrain(i,j) < 0 ) ok = false;
+      }
+    }
+    const auto t2 = clk::now();
+    if ( ok && st.imply() < 0 ) ok = false;
+    const auto t3 = clk::now();
+    if ( ok && !st.branch() ) ok = false;
+    const auto t4 = clk::now();
+    const int  s  = sum(st);
+    const auto t5 = clk::now();
+    const chrono::duration<double,nano> d[nph] = { t1 - t0, t2 - t1, t3 - t2, t4 - t3, t5 - t4 };
+    for ( int p = 0; p < nph; p++ ) t[p].push_back(d[p].count());
+    // the result
+    if ( golden ) {
+      for ( int i = 0; i < st.tr; i++ ) {
+        for ( int j = 0; j < st.tc; j++ ) ok &= i < tr && j < tc && st.n[i][j] == knownH[i][j];
+      }
+      ok &= s == answerH;
+    }
+    else ok &= st.valid();
+    if ( !ok ) {
+      cout << "WRONG RESULT in repetition " << k << ", answer " << s << endl;
+      st.print();
+      return 1;
+    }
+  }
+  cout << "repetitions: " << reps << ", squares: " << pz.tr*pz.tc << endl;
+  cout << setw(10) << "phase" << setw(14) << "median ns" << setw(14) << "p99 ns"
+       << setw(16) << "squares/s" << endl;
+  for ( int p = 0; p < nph; p++ ) {
+    sort(t[p].begin(),t[p].end());
+    const double med = t[p][t[p].size() / 2];
+    const double p99 = t[p][t[p].size() * 99 / 100];
+    cout << setw(10) << phase[p] << setw(14) << fixed << setprecision(0) << med
+         << setw(14) << p99 << setw(16) << (med > 0 ? pz.tr*pz.tc * 1e9 / med : 0) << endl;
+  }
+  return 0;
+}
+
+//******************************************************************************
+// run() solves a puzzle with the solver for its table size
+
+template <int TR, int TC, class M = mark_t> int run(const puzzle& pz, const string& opt, int nthreads) {
     cout << "Hello, world!" << endl;
-    init_regs();
-    
-    state first;
+    state<TR,TC,M> first(pz);
     first.print();
     // apply initial constrains
     bool ok = true;
-    for ( int i = 0; i < tr && ok; i++ ) {
-      for ( int j = 0; j < tc && ok; j++ ) {
+    for ( int i = 0; i < first.tr && ok; i++ ) {
+      for ( int j = 0; j < first.tc && ok; j++ ) {
           if ( first.n[i][j] > 0 ) {
 //               cout << i << " " << j << endl;
               ok &= first.constrain(i,j);
@@ -464,10 +2287,326 @@ int main(int argc, char **argv) {
       }
     }
     cout << "ok: " << ok << endl;
-    first.printx();
-    first.imply();
-    first.printx();
+    if ( opt == "-count" || opt == "-unique" ) {
+      counter<TR,TC,M> cnt(opt == "-unique" ? 2 : 0);
+      const long k = ok && first.imply() >= 0 ? cnt.run(first,nthreads) : 0;
+      if ( opt == "-count" ) cout << "solutions: " << k << endl;
+      else cout << (k == 0 ? "NO SOLUTION" : k == 1 ? "UNIQUE" : "NOT UNIQUE") << endl;
+      return 0;
+    }
+    if ( opt == "-b" && pz.tr * pz.tc <= bmax && pz.nv <= nb ) { // bitboard engine
+      btables bt(pz);
+      bstate  fast(bt,first);
+      fast.imply();
+      fast.events.print();
+      fast.store(first);
+    }
+    else {
+      if      ( opt == "-s" ) first.sweep();
+      else if ( opt == "-t" ) { // trial and error if implications are not enough
+        if ( !first.search() ) cout << "NO SOLUTION" << endl;
+      }
+      else                    first.imply();
+      first.events.print();
+    }
     first.print();
     sum(first);
     return 0;
 }
+
+//******************************************************************************
+// edit() reads edits of the puzzle from stdin, one per line: "+ r c m" puts
+// clue m at (r,c), "- r c" takes the clue at (r,c) out. It prints for each
+// the squares decided (with their values) and released, the solutions left
+// and the time taken.
+
+template <int TR, int TC, class M = mark_t> int edit(const puzzle& pz, long limit, int nthreads, bool check) {
+  editor<TR,TC,M> ed(pz,limit,nthreads);
+  int differ = 0; // edits after which the state is not that of a fresh start
+  auto show = [&](const char* what, const typename editor<TR,TC,M>::report& rep) {
+    cout << what << "  decided";
+    for ( int q : rep.decided ) cout << " (" << q / pz.tc << ',' << q % pz.tc << ")=" << int(ed.st.n[0][q]);
+    cout << "  released";
+    for ( int q : rep.released ) cout << " (" << q / pz.tc << ',' << q % pz.tc << ')';
+    if ( limit >= 0 ) cout << "  solutions " << rep.solutions << (limit && rep.solutions >= limit ? "+" : "");
+    cout << "  " << long(rep.us) << " us" << endl;
+    if ( !check ) return;
+    const auto diff = ed.check();
+    if ( diff.empty() ) return;
+    differ++;
+    cout << "  differs from a fresh start at";
+    for ( int q : diff ) cout << " (" << q / pz.tc << ',' << q % pz.tc << ')';
+    cout << endl;
+  };
+  show("start",ed.edit([]() { return 1; }));
+  string line;
+  while ( getline(cin,line) ) {
+    istringstream in(line);
+    char op = 0;
+    int  r, c, m = 0;
+    if ( !(in >> op) || op == '#' ) continue;
+    if ( !(in >> r >> c) || (op == '+' && !(in >> m)) || (op != '+' && op != '-') ||
+         r < 0 || r >= pz.tr || c < 0 || c >= pz.tc ) {
+      cout << "bad edit: " << line << endl;
+      continue;
+    }
+    const auto rep = op == '+' ? ed.add(r,c,m) : ed.remove(r,c);
+    show(rep.status > 0 ? "done" : rep.status < 0 ? "conflict" : "no change",rep);
+  }
+  return differ ? 1 : 0;
+}
+
+//******************************************************************************
+// Batch mode. Puzzles are read from a file or stdin, a chunk at a time, and
+// solved by a fixed pool of threads. Each worker takes the next puzzle of the
+// chunk and solves it with its own state; the puzzles and their region
+// tables are shared read only. Every puzzle gives one line, in input order:
+// the values row by row (space separated if over 9), the answer, and the
+// status (solved/unsolvable).
+
+struct pool { // fixed set of threads, running jobs 0..n-1 of a batch
+  vector<thread>         threads;
+  mutex                  m;
+  condition_variable     cv;      // a new batch or quit
+  condition_variable     cv_done; // all threads are done with the batch
+  function<void(size_t)> job;
+  size_t                 njobs = 0;
+  atomic<size_t>         next;    // next job to take
+  int                    busy = 0; // threads working on the batch
+  unsigned               gen  = 0; // batch number
+  bool                   quit = false;
+  pool(int nthreads) {
+    for ( int t = 0; t < max(nthreads,1); t++ ) threads.emplace_back([this]() {
+      unsigned seen = 0;
+      while ( true ) {
+        {
+          unique_lock<mutex> lk(m);
+          cv.wait(lk,[this,&seen]() { return quit || gen != seen; });
+          if ( quit ) return;
+          seen = gen;
+        }
+        for ( size_t k; (k = next++) < njobs; ) job(k);
+        lock_guard<mutex> lk(m);
+        if ( --busy == 0 ) cv_done.notify_one();
+      }
+    });
+  }
+  ~pool() {
+    { lock_guard<mutex> lk(m); quit = true; }
+    cv.notify_all();
+    for ( auto& t : threads ) t.join();
+  }
+  void run(size_t n, function<void(size_t)> f) { // returns when all n are done
+    unique_lock<mutex> lk(m);
+    job   = f;
+    njobs = n;
+    next  = 0;
+    busy  = threads.size();
+    gen++;
+    cv.notify_all();
+    cv_done.wait(lk,[this]() { return busy == 0; });
+  }
+};
+
+template <int TR, int TC, class M = mark_t> string solve_line(const puzzle& pz) {
+  state<TR,TC,M> st(pz);
+  st.events.disable();
+  bool ok = true;
+  for ( int i = 0; i < st.tr && ok; i++ ) {
+    for ( int j = 0; j < st.tc && ok; j++ ) {
+      if ( st.n[i][j] > 0 ) ok = st.constrain(i,j) > 0;
+    }
+  }
+  ok = ok && st.search();
+  string line; // digits, or numbers with a space after each if values go over 9
+  for ( int i = 0; i < st.tr; i++ ) {
+    for ( int j = 0; j < st.tc; j++ ) {
+      if ( pz.nv <= 9 ) line += char('0' + st.n[i][j]);
+      else line += to_string(int(st.n[i][j])) + ' ';
+    }
+  }
+  if ( pz.nv > 9 ) line.pop_back();
+  line += ' ' + to_string(ok ? sum(st) : 0) + (ok ? " solved" : " unsolvable");
+  return line;
+}
+
+string solve_line(const puzzle& pz) {
+  if ( pz.nv <= nb ) {
+    if ( pz.tr ==  7 && pz.tc ==  7 ) return solve_line< 7, 7>(pz);
+    if ( pz.tr ==  9 && pz.tc ==  9 ) return solve_line< 9, 9>(pz);
+    if ( pz.tr == 11 && pz.tc == 11 ) return solve_line<11,11>(pz);
+    return solve_line<0,0>(pz);
+  }
+  if ( pz.nv <= 16 ) return solve_line<0,0,mark_for<16>>(pz);
+  return solve_line<0,0,mark_for<nd>>(pz);
+}
+
+int batch(istream& in, int nthreads) {
+  const size_t   chunk = 256 * max(nthreads,1); // puzzles read at a time
+  pool           workers(nthreads);
+  vector<puzzle> pzs(chunk);
+  vector<string> lines(chunk);
+  size_t total = 0; // puzzles solved
+  int    res   = 1;
+  while ( res > 0 ) {
+    size_t n = 0;
+    while ( n < chunk && (res = pzs[n].read(in)) > 0 ) n++;
+    workers.run(n,[&pzs,&lines](size_t k) { lines[k] = solve_line(pzs[k]); });
+    for ( size_t k = 0; k < n; k++ ) cout << lines[k] << '\n';
+    total += n;
+  }
+  cout << flush;
+  if ( res < 0 ) {
+    cout << "malformed puzzle " << total + 1 << endl;
+    return 1;
+  }
+  return 0;
+}
+
+//******************************************************************************
+// Lockstep mode. Puzzles are read as in batch mode; consecutive puzzles on the
+// same table share a lockstep run, up to its n of lanes. Every puzzle gives
+// one line: the values row by row (0 where unknown) and the status, solved
+// (all known), open (implications stop short) or conflict. A last comment
+// line gives the count and the time.
+
+int lanes(istream& in) {
+  typedef chrono::steady_clock clk;
+  vector<puzzle> pzs;
+  size_t total = 0;
+  double us    = 0; // in lockstep runs
+  int    res   = 1;
+  auto run = [&]() { // the puzzles read, all on the table of the first
+    if ( pzs.empty() ) return;
+    const auto t0 = clk::now();
+    lockstep   ls(pzs[0]);
+    for ( size_t l = 0; l < pzs.size(); l++ ) ls.load(l,pzs[l].known);
+    ls.imply();
+    us += chrono::duration<double,micro>(clk::now() - t0).count();
+    for ( size_t l = 0; l < pzs.size(); l++ ) {
+      string line;
+      bool   all = true;
+      for ( int q = 0; q < ls.nsq; q++ ) {
+        const int m = ls.value(l,q);
+        line += char('0' + m);
+        all  &= m > 0;
+      }
+      cout << line << (ls.bad.test(l) ? " conflict" : all ? " solved" : " open") << '\n';
+    }
+    total += pzs.size();
+    pzs.clear();
+  };
+  puzzle pz;
+  while ( (res = pz.read(in)) > 0 ) {
+    if ( pz.nv > nb ) { // keeps the lines in input order
+      run();
+      cout << "regions over " << nb << " squares not supported in lockstep mode" << '\n';
+      total++;
+      continue;
+    }
+    if ( pzs.size() == lockstep::nl ||
+         (pzs.size() && (pz.tr != pzs[0].tr || pz.tc != pzs[0].tc || pz.sq2reg != pzs[0].sq2reg)) ) run();
+    pzs.push_back(pz);
+  }
+  run();
+  cout << "# " << total << " puzzles, " << lockstep::nl << " lanes, " << long(us) << " us" << endl;
+  if ( res < 0 ) {
+    cout << "malformed puzzle " << total + 1 << endl;
+    return 1;
+  }
+  return 0;
+}
+
+
+int main(int argc, char **argv) {
+    string   opt;  // -b, -s, -t, -c, -count, -unique, -batch, -lanes, -gen, -bench or -edit
+    string   file; // puzzle file; the built-in puzzle if none (stdin for -batch, -lanes)
+    int      nthreads = thread::hardware_concurrency(); // -j n
+    unsigned seed = 1; // -seed s, for -gen
+    int      n    = 0;  // -n count: puzzles per size and density for -gen (10),
+                        //           repetitions for -bench (1000),
+                        //           solutions counted up to for -edit (100, < 0 none)
+    int      size = 0;  // -size n, for -gen: n x n tables only
+    bool     check = false; // -check, for -edit: compare each edit with a fresh start
+    for ( int i = 1; i < argc; i++ ) {
+      const string arg = argv[i];
+      if      ( arg == "-j"    && i + 1 < argc ) nthreads = atoi(argv[++i]);
+      else if ( arg == "-seed" && i + 1 < argc ) seed     = atoi(argv[++i]);
+      else if ( arg == "-n"    && i + 1 < argc ) n        = atoi(argv[++i]);
+      else if ( arg == "-size" && i + 1 < argc ) size     = atoi(argv[++i]);
+      else if ( arg == "-prof" && i + 1 < argc ) profiles.file = argv[++i];
+      else if ( arg == "-check" )                check    = true;
+      else if ( arg[0] == '-' ) opt  = arg;
+      else                      file = arg;
+    }
+    if ( opt == "-gen" ) {
+      quiet = true;
+      return gen_corpus(seed,n > 0 ? n : 10,size);
+    }
+    if ( opt == "-batch" ) {
+      quiet = true;
+      if ( !file.size() ) return batch(cin,nthreads);
+      ifstream in(file);
+      if ( !in ) {
+        cout << "cannot open " << file << endl;
+        return 1;
+      }
+      return batch(in,nthreads);
+    }
+    if ( opt == "-lanes" ) {
+      if ( !file.size() ) return lanes(cin);
+      ifstream in(file);
+      if ( !in ) {
+        cout << "cannot open " << file << endl;
+        return 1;
+      }
+      return lanes(in);
+    }
+    puzzle pz = puzzle::builtin();
+    if ( opt == "-c" ) { // the built-in puzzle as solved by the compiler
+      state<tr,tc> st(pz);
+      copy(solvedC.n[0],solvedC.n[0] + tr*tc,st.n[0]);
+      st.print();
+      cout << "SIG: " << answerC << endl;
+      return 0;
+    }
+    if ( file.size() ) {
+      ifstream in(file);
+      if ( pz.read(in) < 1 ) {
+        cout << "cannot read a puzzle from " << file << endl;
+        return 1;
+      }
+    }
+    if ( opt == "-bench" ) {
+      quiet = true;
+      const int  reps   = n > 0 ? n : 1000;
+      const bool golden = file.empty();
+      if ( pz.nv <= nb ) {
+        if ( pz.tr ==  7 && pz.tc ==  7 ) return bench< 7, 7>(pz,reps,golden);
+        if ( pz.tr ==  9 && pz.tc ==  9 ) return bench< 9, 9>(pz,reps,golden);
+        if ( pz.tr == 11 && pz.tc == 11 ) return bench<11,11>(pz,reps,golden);
+        return bench<0,0>(pz,reps,golden);
+      }
+      if ( pz.nv <= 16 ) return bench<0,0,mark_for<16>>(pz,reps,golden);
+      return bench<0,0,mark_for<nd>>(pz,reps,golden);
+    }
+    if ( opt == "-edit" ) {
+      quiet = true;
+      const long limit = n ? n : 100;
+      if ( pz.nv <= nb ) {
+        if ( pz.tr ==  9 && pz.tc ==  9 ) return edit< 9, 9>(pz,limit,nthreads,check);
+        return edit<0,0>(pz,limit,nthreads,check);
+      }
+      if ( pz.nv <= 16 ) return edit<0,0,mark_for<16>>(pz,limit,nthreads,check);
+      return edit<0,0,mark_for<nd>>(pz,limit,nthreads,check);
+    }
+    // common sizes get their own solver, regions over nb squares wider marks
+    if ( pz.nv <= nb ) {
+      if ( pz.tr ==  7 && pz.tc ==  7 ) return run< 7, 7>(pz,opt,nthreads);
+      if ( pz.tr ==  9 && pz.tc ==  9 ) return run< 9, 9>(pz,opt,nthreads);
+      if ( pz.tr == 11 && pz.tc == 11 ) return run<11,11>(pz,opt,nthreads);
+      return run<0,0>(pz,opt,nthreads);
+    }
+    if ( pz.nv <= 16 ) return run<0,0,mark_for<16>>(pz,opt,nthreads);
+    return run<0,0,mark_for<nd>>(pz,opt,nthreads);
+}
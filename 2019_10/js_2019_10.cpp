@@ -2,6 +2,18 @@
 #include <vector>
 #include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <map>
+#include <fstream>
 
 using namespace std;
 
@@ -28,11 +40,13 @@ using namespace std;
 //******************************************************************************
 // Let's retype target-square table given in the puzzle.
 // Below, empty squares are represented as 0s and they are non-target.
+// This is the built-in board. Other boards are read at run time, see
+// read_board(), so the table in use is tt, tor x toc.
 
-constexpr int tor = 17; // n of original table rows
-constexpr int toc = 17; // n of original columns
+constexpr int btor = 17; // n of built-in table rows
+constexpr int btoc = 17; // n of built-in columns
 
-constexpr int tt[tor][toc] = // target table from the puzzle
+constexpr int btt[btor][btoc] = // target table from the puzzle
 { {  0,  0,  0,  0,  0,  0,  0,  0,  0,  8,  0,  0,  0,  2,  0,  0,  0, },
   {  0,  0,  0, 12,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  7,  0,  0, },
   {  4,  0,  0,  0,  0, 10,  0,  0,  0,  0,  0,  0,  3,  0,  0,  0,  0, },
@@ -50,6 +64,17 @@ constexpr int tt[tor][toc] = // target table from the puzzle
   {  0,  0,  0,  0,  3,  0,  0,  0,  0,  0,  0,  7,  0,  0,  0,  0,  6, },
   {  0,  0, 12,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  4,  0,  0,  0, },
   {  0,  0,  0,  2,  0,  0,  0, 18,  0,  0,  0,  0,  0,  0,  0,  0,  0, }, };
+
+int tor = btor; // n of table rows
+int toc = btoc; // n of table columns
+vector<vector<int>> tt; // target table in use
+
+void init_tt() { // the built-in board
+  tor = btor; toc = btoc;
+  tt.assign(tor,vector<int>(toc,0));
+  for ( int i = 0; i < tor; i++ )
+    for ( int j = 0; j < toc; j++ ) tt[i][j] = btt[i][j];
+}
   
 //******************************************************************************
 // When writing the code it will be convenient to use table coordinates wrapped
@@ -77,6 +102,7 @@ inline bool in_table( const TCoord& loc ) {
 vector<TCoord> ltsq; // list of target squares; list of coordinates
 
 void init_ltsq() {
+  ltsq.clear();
   for ( int i = 0; i < tor; i++ )
     for ( int j = 0; j < toc; j++ ) 
       if ( tt[i][j] ) {
@@ -85,111 +111,86 @@ void init_ltsq() {
 }
 
 //******************************************************************************
-// To solve the problem we look at the grid of tt square corners
-// Note, however, that triangle interiors cannot overlap and we will need
-// some functionality to check it. This problem can be solved in various
-// ways. Conceptually, the easiest way is to make the grid more  -
-// dense enough to make any two overlaping triangles share an internal
-// point, i.e. point that does not belong to the triangle's line segments.
-// If we take into account all possilble triangle sizes (we will look
-// at this issue later) our grid needs more than 7 times as many lines.
-// For simplicity, a scale of 10 will serve the purpose.
+// To solve the problem we look at the grid of tt square corners, i.e. at
+// grid points (i,j) with 0 <= i <= tor and 0 <= j <= toc.
 // Note that the original target-square table is 17x17, and grid 18x18.
+// Triangle vertices are grid points, so all the geometry below is exact 
+// integer arithmetic.
 
-constexpr int scale = 10;
-constexpr int gr = tor * scale + 1; // n of our grid rows
-constexpr int gc = toc * scale + 1; // n of our grid columns
-
-inline int t2g(int i) { return i* scale; } // translates to our grid index
-
+inline bool in_grid( const TCoord& loc ) {
+  return loc.first >= 0   && loc.second >= 0 &&
+         loc.first <= tor && loc.second <= toc;
+}
 
 //******************************************************************************
-// When writing the code it will be convenient to use grid coordinates
-// wrapped in a single object rather than two single numbers.
-// The code will be clearer if grid coordinates are represented by a 
-// structure different from TCoord.
+// Triangle interiors cannot overlap and we will need some functionality to 
+// check it. Triangles and target squares are convex polygons with grid point
+// vertices. By the separating axis theorem, the interiors of two convex 
+// polygons are disjoint iff their projections onto the normal of one of 
+// their edges do not overlap (sharing an end point is fine). The normal of 
+// an edge between grid points is an integer vector, so projections are 
+// integer dot products.
 
-struct GCoord : public pair<int,int> { // coordinates
-  void swap() { std::swap(first,second); }
-  void operator+=(const GCoord& o) {
-    first  += o.first;
-    second += o.second;
+struct Poly { // convex polygon
+  int    n = 0;  // n of vertices, 3 or 4
+  TCoord v[4];   // vertices in boundary order
+  TCoord lo, hi; // bounding box corners
+  void add( const TCoord& p ) {
+    if ( !n ) { lo = p; hi = p; }
+    lo.first  = min(lo.first, p.first);  hi.first  = max(hi.first, p.first);
+    lo.second = min(lo.second,p.second); hi.second = max(hi.second,p.second);
+    v[n++] = p;
   }
-  GCoord()             { first = 0; second = 0; }
-  GCoord(int i, int j) { first = i; second = j; }
 };
 
-inline bool in_grid( const GCoord& loc ) {
-  return loc.first >= 0  && loc.second >= 0 &&
-         loc.first <= gr && loc.second <= gc;
+inline bool separates( const Poly& a, const Poly& b ) {
+  // does the normal of an edge of a separate a and b?
+  for ( int e = 0; e < a.n; e++ ) {
+    const TCoord& p = a.v[e];
+    const TCoord& q = a.v[(e+1) % a.n];
+    const int nr = q.second - p.second; // edge normal
+    const int nc = p.first  - q.first;
+    int amin = INT_MAX, amax = INT_MIN;
+    for ( int k = 0; k < a.n; k++ ) {
+      int d = nr * a.v[k].first + nc * a.v[k].second;
+      amin = min(amin,d); amax = max(amax,d);
+    }
+    int bmin = INT_MAX, bmax = INT_MIN;
+    for ( int k = 0; k < b.n; k++ ) {
+      int d = nr * b.v[k].first + nc * b.v[k].second;
+      bmin = min(bmin,d); bmax = max(bmax,d);
+    }
+    if ( amax <= bmin || bmax <= amin ) return true;
+  }
+  return false;
 }
 
-inline GCoord t2g( const TCoord loc ) {
-    GCoord gloc(t2g(loc.first),t2g(loc.second));
-    return gloc;
+inline bool overlap( const Poly& a, const Poly& b ) { // do interiors overlap?
+  if ( a.hi.first  <= b.lo.first  || b.hi.first  <= a.lo.first  ) return false;
+  if ( a.hi.second <= b.lo.second || b.hi.second <= a.lo.second ) return false;
+  return !separates(a,b) && !separates(b,a);
 }
 
-//******************************************************************************
-// A triangle must cover only its target square. Since we are looking at a 
-// more dense grid, it is enough to check if the triangle we are placing on
-// the grid shares any of its internal points with another target square.
-// Let's create a grid table that marks internal points of all original
-// tt target squares with their tt table coordinates.
-// Note that tt square (0,0) is not a target, so we can use it as "empty".
-// So, since c++ initializes all static storage to 0, all we need to do
-// is to mark non-empty grid points.
-
-TCoord gmsqi[gr][gc]; // grid marked tt square interiors
-
-void init_gmsqi() {
-  for ( auto sq : ltsq ) {
-    int r = sq.first;  
-    int c = sq.second;  
-    for ( int i = t2g(r)+1; i < t2g(r+1); i++ )
-      for ( int j = t2g(c)+1; j < t2g(c+1); j++ ) {
-        gmsqi[i][j] = sq; 
-      }
-  }
+inline Poly square( const TCoord& tl ) { // tt square as a polygon
+  Poly sq;
+  sq.add(TCoord(tl.first,  tl.second  ));
+  sq.add(TCoord(tl.first,  tl.second+1));
+  sq.add(TCoord(tl.first+1,tl.second+1));
+  sq.add(TCoord(tl.first+1,tl.second  ));
+  return sq;
 }
 
 //******************************************************************************
-// A triangle has boundary grid points and internal/gut grid points.
-// Since we are using a dense grid, all we need to pay attention to are
-// internal points.
-// Class gps is used for this purpose.
-// '.' -- "empty" grid point 
-// '*' -- internal
-
-
-struct Gps { // grid point status: empty or internal
-  char s[gr][gc];
-    Gps() { for(int i = 0; i < gr; i++ )
-      for( int j = 0; j < gc; j++ ) s[i][j] = '.'; }
-    Gps(const Gps& o) { 
-      for(int i = 0; i < gr; i++ ) 
-        for( int j = 0; j < gc; j++ ) s[i][j] = o.s[i][j]; }
-    bool is_empty(const GCoord& loc) const {
-      return s[loc.first][loc.second] == '.';
-    }     
-    bool is_internal(const GCoord& loc) const {
-      return s[loc.first][loc.second] == '*';
-    }     
-    void mark_internal(const GCoord& loc) {
-      s[loc.first][loc.second] = '*';
-    }     
-    bool is_covered(const TCoord& tloc) const {
-      int i = t2g(tloc.first)  + 1;
-      int j = t2g(tloc.second) + 1;
-      return s[i][j] == '*';
-    }
-    void print() const {
-      cout << "Gps: " << endl;
-      for(int i = 0; i < gr; i++ ) {
-        for( int j = 0; j < gc; j++ ) cout << ' ' << s[i][j]; 
-        cout << endl;
-      }
-    }
-};
+// A triangle must cover only its target square, i.e. its interior may not 
+// overlap any other target square. Let's keep the target squares as polygons,
+// in the order of ltsq.
+
+vector<Poly> ltsqp; // list of target squares; list of polygons
+
+void init_ltsqp() {
+  ltsqp.clear();
+  for ( auto sq : ltsq ) ltsqp.push_back(square(sq));
+}
 
 //******************************************************************************
 // An attempt to solve the puzzle manually may involve cutting paper triangles of
@@ -206,128 +207,131 @@ struct Config { // triangle configuration
 };
 
 //******************************************************************************
-// A template defines its corners, boundary points, and positions.
-// The square angle corner is located at (0,0). For position (0,0),
-// to get coordinates of grid points covered by the template, add its corners,
-// boundary, and internal coordinates to the grid coordinates of the target 
-// square.
+// A template defines its legs and positions.
+// The square angle corner is located at (0,0), the ends of the legs at (0,c)
+// and (r,0). For position (0,0), to get grid coordinates of the triangle 
+// corners, add the template corners to the coordinates of the target square.
 // transform() computes the relative location of each triangle point taking
 // into account triangle configuration. 
+// A template keeps its positions in the flat position table, see below.
+
+struct Pos { int i, j; }; // target square position - upper left corner
 
 struct Tm {
-  vector<GCoord> v; // vertices/corners
-  vector<GCoord> b; // boundary but not corners
-  vector<GCoord> g; // internal "guts"
-  vector<TCoord> p; // target square positions - upper left corner
-  Tm(const int r, const int c) { // r, c == original table size
-    v.emplace_back(t2g(0),t2g(0)); // scaled coordinates
-    v.emplace_back(t2g(0),t2g(c)); 
-    v.emplace_back(t2g(r),t2g(0));
-
-    // find t.b
-    for ( int j = 1; j < t2g(c); j++ ) { b.emplace_back(0,j); }
-    for ( int i = 1; i < t2g(r); i++ ) { b.emplace_back(i,0); }
-    const int rf = gcd(r,c); // reduction factor
-    const int rr = r / rf; // reduced r -- we want relatively prime pair
-    const int rc = c / rf; // reduced c
-    for ( int k  = 1; k < t2g(rf); k++ ) { b.emplace_back(r-k*rr,0+k*rc); }
-
-    // find t.g 
-    for ( int i = 1; i < t2g(r); i++ ) // skip original (0,c) and (r,0)
-      // only columns that satisfy floating point j < (t2g(r)-i)*(c/r)
-      for ( int j = 1; j*rr < (t2g(r)-i)*rc; j++) 
-        g.emplace_back(i,j);
-
-    // find t.p -- (i+1,j+1) must be inside or at boundary
-    for ( int i = 0; i < r; i++ ) 
-      // only columns that satisfy floating point (j+1) <= (r-i-1)*(c/r)
-      for ( int j = 0; (j+1)*rr <= (r-i-1)*rc; j++) 
-        p.emplace_back(i,j);
+  int r  = 0; // leg down, n of rows
+  int c  = 0; // leg across, n of columns
+  int p0 = 0; // first position in the position table
+  int np = 0; // n of positions
+  bool symmetrical() const { return r == c; }
+  TCoord corner( int e ) const { // 0 -- square angle, 1 -- end of c, 2 -- end of r
+    return e == 0 ? TCoord(0,0) : e == 1 ? TCoord(0,c) : TCoord(r,0);
   }
-  bool symmetrical() const { return v[1].second == v[2].first; }
-  GCoord transform( const Config& cnfg, const TCoord loc ) const {
+  TCoord pos( int p ) const;
+  TCoord transform( const Config& cnfg, const TCoord loc ) const {
     TCoord res = loc;
-    res.first  -= p[cnfg.p].first;
-    res.second -= p[cnfg.p].second;
+    res.first  -= pos(cnfg.p).first;
+    res.second -= pos(cnfg.p).second;
     if ( cnfg.s ) swap(res.first,res.second);
     if ( cnfg.h ) res.first  = -res.first  + 1;
     if ( cnfg.v ) res.second = -res.second + 1;
-    return t2g(res);
-  }
-  GCoord transform( const Config& cnfg, const GCoord loc ) const {
-    GCoord res = loc;
-    res.first  -= t2g(p[cnfg.p].first);
-    res.second -= t2g(p[cnfg.p].second);
-    if ( cnfg.s ) swap(res.first,res.second);
-    if ( cnfg.h ) res.first  = -res.first  + t2g(1);
-    if ( cnfg.v ) res.second = -res.second + t2g(1);
     return res;
   }
-  int gcd (int a, int b) const {
-    int x;
-    while (b)
-      {
-        x = a % b;
-        a = b;
-        b = x;
-      }
-    return a;
-  }
-
 };
 
 //******************************************************************************
-// It is easy to find all temlate sizes needed for the targets in tt table
-
-Tm tm2_2x2(2,2);
-Tm tm3_2x3(2,3);
-Tm tm4_2x4(2,4);
-Tm tm5_2x5(2,5);
-Tm tm6_2x6(2,6);
-Tm tm6_4x3(4,3);
-Tm tm7_2x7(2,7);
-Tm tm8_2x8(2,8);
-Tm tm8_4x4(4,4);
-Tm tm9_2x9(2,9);
-Tm tm9_3x6(3,6);
-Tm tm10_2x10(2,10);
-Tm tm10_4x5(4,5);
-Tm tm11_2x11(2,11);
-Tm tm12_2x12(2,12);
-Tm tm12_4x6(4,6);
-Tm tm12_8x3(8,3);
-Tm tm14_2x14(2,14);
-Tm tm14_4x7(4,7);
-Tm tm18_2x18(2,18); // does not fit tt
-Tm tm18_4x9(4,9);
-Tm tm18_3x12(3,12);
-Tm tm18_6x6(6,6);
-Tm tm20_2x20(2,20); // does not fit tt
-Tm tm20_4x10(4,10);
-Tm tm20_8x5(8,5);
+// Templates are found at compile time. The templates of target number n are
+// leg pairs r x c, r <= c, with r * c == 2 * n, that have at least one 
+// position. (i,j) is a position if square corner (i+1,j+1) is inside the 
+// template or at its boundary. templates() keeps those that fit the table.
+// All templates are kept in one flat table ordered by number, and all their
+// positions in another.
+
+constexpr int maxn = 128; // largest target number supported
+
+constexpr int c_npos( int r, int c ) { // n of positions of template r x c
+  int n = 0;
+  for ( int i = 0; i < r; i++ )
+    for ( int j = 0; (j+1)*r <= (r-i-1)*c; j++ ) n++;
+  return n;
+}
+
+constexpr bool c_legal( int n, int r ) { // is r x 2n/r a template of n?
+  if ( r * r > 2 * n || 2 * n % r ) return false;
+  return c_npos(r,2*n/r) > 0;
+}
+
+constexpr int c_ntm() {
+  int k = 0;
+  for ( int n = 1; n <= maxn; n++ )
+    for ( int r = 1; r * r <= 2 * n; r++ ) k += c_legal(n,r);
+  return k;
+}
+
+constexpr int c_ntpos() {
+  int q = 0;
+  for ( int n = 1; n <= maxn; n++ )
+    for ( int r = 1; r * r <= 2 * n; r++ ) 
+      if ( c_legal(n,r) ) q += c_npos(r,2*n/r);
+  return q;
+}
+
+constexpr int ntm   = c_ntm();   // n of templates
+constexpr int ntpos = c_ntpos(); // n of positions of all templates
+
+struct TmTable {
+  Tm  tm[ntm];
+  Pos pos[ntpos];
+  int first[maxn+2]; // templates of number n: tm[first[n]] .. tm[first[n+1]-1]
+};
+
+constexpr TmTable c_tmtable() {
+  TmTable t{};
+  int k = 0, q = 0;
+  for ( int n = 0; n <= maxn; n++ ) {
+    t.first[n] = k;
+    for ( int r = 1; n && r * r <= 2 * n; r++ ) {
+      if ( !c_legal(n,r) ) continue;
+      const int c = 2 * n / r;
+      Tm& tm = t.tm[k++];
+      tm.r = r; tm.c = c; tm.p0 = q; tm.np = c_npos(r,c);
+      for ( int i = 0; i < r; i++ )
+        for ( int j = 0; (j+1)*r <= (r-i-1)*c; j++ ) {
+          t.pos[q].i = i; t.pos[q].j = j; q++;
+        }
+    }
+  }
+  t.first[maxn+1] = k;
+  return t;
+}
+
+constexpr TmTable tmt = c_tmtable(); // template table
+
+inline TCoord Tm::pos( int p ) const {
+  return TCoord(tmt.pos[p0+p].i,tmt.pos[p0+p].j);
+}
 
 //******************************************************************************
 // We will need to easily look up all templates by target number.
+// Only templates that fit the table in either orientation are listed. 
+// The lists are cached by table size, so boards of one size share them.
+
+typedef vector<vector<const Tm*>> N2tm; // number to template list
 
-vector<vector<const Tm*>> n2tm; // number to template list
+map<pair<int,int>,N2tm> n2tms; // by table size
 
-void init_n2tm() {
-  n2tm.resize(21);
-  auto e = [](int i, Tm& t){ n2tm[i].emplace_back(&t); }; 
-  e( 2,tm2_2x2);
-  e( 3,tm3_2x3);
-  e( 4,tm4_2x4);
-  e( 5,tm5_2x5);
-  e( 6,tm6_2x6);   e( 6,tm6_4x3);
-  e( 7,tm7_2x7);  
-  e( 8,tm8_2x8);   e( 8,tm8_4x4);
-  e( 9,tm9_2x9);   e( 9,tm9_3x6);
-  e(10,tm10_2x10); e(10,tm10_4x5);
-  e(11,tm11_2x11);
-  e(12,tm12_2x12); e(12,tm12_4x6); e(12,tm12_8x3);
-  e(14,tm14_2x14); e(14,tm14_4x7);
-  e(18,tm18_4x9);  e(18,tm18_3x12); e(18,tm18_6x6);
-  e(20,tm20_4x10); e(20,tm20_8x5);
+const vector<const Tm*>& templates( int n ) {
+  assert( n >= 1 && n <= maxn );
+  N2tm& n2tm = n2tms[make_pair(tor,toc)];
+  if ( n2tm.empty() ) {
+    n2tm.resize(maxn+1);
+    for ( int m = 1; m <= maxn; m++ )
+      for ( int k = tmt.first[m]; k < tmt.first[m+1]; k++ ) {
+        const Tm& t = tmt.tm[k];
+        if ( (t.r <= tor && t.c <= toc) || (t.c <= tor && t.r <= toc) ) 
+          n2tm[m].push_back(&t);
+      }
+  }
+  return n2tm[n];
 }
 
 
@@ -342,55 +346,45 @@ void print( const pair<int,int>& p) {
 void print( const Tm& t)
 {
   cout << endl;
-  cout << "v: "; for( auto e : t.v) print(e); cout << endl;
-  cout << "b: "; for( auto e : t.b) print(e); cout << endl;
-  cout << "g: "; for( auto e : t.g) print(e); cout << endl;
-  cout << "p: "; for( auto e : t.p) print(e); cout << endl;
+  cout << "v: "; for( int e = 0; e < 3; e++ ) print(t.corner(e)); cout << endl;
+  cout << "p: "; for( int p = 0; p < t.np; p++ ) print(t.pos(p)); cout << endl;
 }
 #endif
 
 //******************************************************************************
 // Now the algorithmic part.
+// image() finds the triangle a template in a particular configuration
+//         makes when it covers a given target square.
 // fits()  checks if a template in a particular configuration can be used to 
-//         cover a given target square.
-// place() places a template in a particular configuration 
+//         cover a given target square on the empty grid.
 // hll()   find horizonal leg length
 
-bool fits( const Gps& gps, const TCoord& tl, const Tm& tm, const Config& cnfg) {
+Poly image( const TCoord& tl, const Tm& tm, const Config& cnfg) {
   // tl   -- target square location
   // tm   -- triangle template
   // cnfg -- triangle configuration
-  // assert triangle area == template area / 2 --- wrong template?
-  assert( 2 * tt[tl.first][tl.second] * scale * scale == tm.v[1].second * tm.v[2].first );
-  // check if corners are in table, are they in another triangle
-  auto image = [&tl,&tm,&cnfg](const GCoord& templloc) {
-    auto al  = tm.transform(cnfg,templloc);
-         al += t2g(tl); // actual grid location
-    return al;
-  };
-  auto v0 = image(tm.v[0]); if (!in_grid(v0) || gps.is_internal(v0)) return 0;
-  auto vc = image(tm.v[1]); if (!in_grid(vc) || gps.is_internal(vc)) return 0;
-  auto vr = image(tm.v[2]); if (!in_grid(vr) || gps.is_internal(vr)) return 0;
-  // check if template guts overlap another triangle or target square
-  for ( const auto& gl : tm.g ) {
-    GCoord al  = image(gl);
-    TCoord mk  = gmsqi[al.first][al.second];
-    if ( (mk.first != 0 || mk.second != 0) && mk != tl ) return false;
-    if ( gps.is_internal(al) )              return false;
+  Poly tri;
+  for ( int e = 0; e < 3; e++ ) {
+    TCoord al  = tm.transform(cnfg,tm.corner(e));
+           al += tl; // actual grid location
+    tri.add(al);
   }
-  return true;
+  return tri;
 }
 
-void place( Gps& gps, const TCoord& tl, const Tm& tm, const Config& cnfg) {
-  // place triangle, i.e., mark internal points in gps. 
+bool fits( const TCoord& tl, const Tm& tm, const Config& cnfg) {
   // tl   -- target square location
   // tm   -- triangle template
   // cnfg -- triangle configuration
-  for ( const auto& gl : tm.g ) {
-    GCoord al  = tm.transform(cnfg,gl);
-           al += t2g(tl); // actual grid location
-    gps.mark_internal(al);
-  }
+  // assert triangle area == template area / 2 --- wrong template?
+  assert( 2 * tt[tl.first][tl.second] == tm.r * tm.c );
+  // check if corners are in the grid
+  const Poly tri = image(tl,tm,cnfg);
+  for ( int e = 0; e < tri.n; e++ ) if ( !in_grid(tri.v[e]) ) return false;
+  // check if the triangle overlaps another target square
+  for ( size_t k = 0; k < ltsq.size(); k++ )
+    if ( ltsq[k] != tl && overlap(tri,ltsqp[k]) ) return false;
+  return true;
 }
 
 void print_troc ( const TCoord& tl, const Tm& tm, const Config& cnfg) {
@@ -399,13 +393,10 @@ void print_troc ( const TCoord& tl, const Tm& tm, const Config& cnfg) {
   // tm   -- triangle template
   // cnfg -- triangle configuration
   // assert triangle area == template area / 2 --- wrong template?
-  assert( 2 * tt[tl.first][tl.second]*scale*scale == tm.v[1].second * tm.v[2].first );
-  for ( const auto& e : tm.v ) {
-    GCoord al  = tm.transform(cnfg,e);
-           al += t2g(tl); // actual grid location
-           al.first  /= scale;
-           al.second /= scale;
-    cout << "\t"; print(al);
+  assert( 2 * tt[tl.first][tl.second] == tm.r * tm.c );
+  const Poly tri = image(tl,tm,cnfg);
+  for ( int e = 0; e < tri.n; e++ ) {
+    cout << "\t"; print(tri.v[e]);
   }
 }
 
@@ -415,122 +406,374 @@ int hll( const TCoord& tl, const Tm& tm, const Config& cnfg) {
   // tm   -- triangle template
   // cnfg -- triangle configuration
   // assert triangle area == template area / 2 --- wrong template?
-  assert( 2 * tt[tl.first][tl.second]*scale*scale == tm.v[1].second * tm.v[2].first );
-  if ( !cnfg.s ) return tm.v[1].second / scale;
-  else           return tm.v[2].first  / scale;
+  assert( 2 * tt[tl.first][tl.second] == tm.r * tm.c );
+  if ( !cnfg.s ) return tm.c;
+  else           return tm.r;
 }
 
 //******************************************************************************
-// options() finds the toal number of all templates configurations that fit.
+// A placement is a template in a particular configuration that covers a given
+// target square. All placements that fit the empty grid are listed once, 
+// target by target, in the order options() used to try them.
+// Two placements conflict if their triangles overlap or they cover the same
+// target. cnfl keeps a bitset of conflicting placements for each placement,
+// so placing a triangle just masks its conflicts out of the live set.
+// Only placements whose bounding boxes share a table square can overlap, so
+// they are bucketed by square and tested within buckets.
+// Catalogs are cached by board, so a batch that repeats a board builds its
+// catalog once.
+
+struct Placement {
+  int    k;    // target index in ltsq
+  const  Tm* tm;
+  Config cnfg;
+  Poly   tri;  // triangle on the grid
+};
+
+vector<Placement> plc;    // placement catalog
+vector<int>       pfirst; // placements of target k: pfirst[k] .. pfirst[k+1]-1
+int               pw;     // n of 64-bit words in a placement bitset
+vector<uint64_t>  cnfl;   // conflicts of placement a: cnfl[a*pw] .. 
+
+struct Catalog {
+  vector<Placement> plc;
+  vector<int>       pfirst;
+  int               pw;
+  vector<uint64_t>  cnfl;
+  long              used;   // last use, as catuse
+};
+
+constexpr size_t ncat = 16;  // n of catalogs cached
+map<string,Catalog> cats;    // catalog cache by board
+long                catuse;  // counts catalog uses
+
+string board_key() {
+  string key = to_string(tor) + ' ' + to_string(toc);
+  for ( const auto& row : tt )
+    for ( int n : row ) key += ' ' + to_string(n);
+  return key;
+}
+
+void init_plc() {
+  const string key = board_key();
+  auto it = cats.find(key);
+  if ( it != cats.end() ) {
+    it->second.used = ++catuse;
+    plc = it->second.plc; pfirst = it->second.pfirst;
+    pw  = it->second.pw;  cnfl   = it->second.cnfl;
+    return;
+  }
+  plc.clear();
+  pfirst.clear();
+  for ( size_t k = 0; k < ltsq.size(); k++ ) {
+    const TCoord tl = ltsq[k];
+    pfirst.push_back(plc.size());
+    for ( const Tm* tm : templates(tt[tl.first][tl.second]) ) {
+      Config cnfg; 
+      auto count = [&]() {
+        for ( int p = 0; p < tm->np; p++ ) { 
+          cnfg.p = p;
+          if ( fits(tl,*tm,cnfg) ) 
+            plc.push_back({int(k),tm,cnfg,image(tl,*tm,cnfg)});
+        }
+      };
+                      count(); // h==0, v==0
+      cnfg.h = true;  count(); // h==1, v==0
+      cnfg.v = true;  count(); // h==1, v==1
+      cnfg.h = false; count(); // h==0, v==1
+      if ( tm->symmetrical() ) continue;
+      cnfg.s = true;  count(); // h==0, v==1
+      cnfg.v = false; count(); // h==0, v==0
+      cnfg.h = true;  count(); // h==1, v==0
+      cnfg.v = true;  count(); // h==1, v==1
+    }
+  }
+  pfirst.push_back(plc.size());
+  const int np = plc.size();
+  pw = (np + 63) / 64;
+  cnfl.assign(size_t(np) * pw, 0);
+  auto set = [](int a, int b) { cnfl[size_t(a)*pw + b/64] |= uint64_t(1) << (b%64); };
+  auto is_set = [](int a, int b) { return cnfl[size_t(a)*pw + b/64] >> (b%64) & 1; };
+  vector<vector<int>> bucket(tor*toc); // placements by table square
+  for ( int a = 0; a < np; a++ ) {
+    const Poly& t = plc[a].tri;
+    for ( int i = t.lo.first; i < t.hi.first; i++ )
+      for ( int j = t.lo.second; j < t.hi.second; j++ ) bucket[i*toc+j].push_back(a);
+  }
+  for ( const auto& bk : bucket )
+    for ( size_t x = 0; x < bk.size(); x++ )
+      for ( size_t y = x; y < bk.size(); y++ ) {
+        const int a = bk[x], b = bk[y];
+        if ( is_set(a,b) ) continue;
+        if ( plc[a].k == plc[b].k || overlap(plc[a].tri,plc[b].tri) ) {
+          set(a,b); set(b,a);
+        }
+      }
+  if ( cats.size() >= ncat ) { // the least recently used goes
+    auto lru = cats.begin();
+    for ( auto c = cats.begin(); c != cats.end(); ++c ) if ( c->second.used < lru->second.used ) lru = c;
+    cats.erase(lru);
+  }
+  cats[key] = Catalog{plc,pfirst,pw,cnfl,++catuse};
+#if 0
+  cout << "placements: " << np << endl;
+#endif
+}
+
+//******************************************************************************
+// Class gps keeps the placements that still fit, and the covered targets.
+// The search runs on a single gps. place() records the words it changes on
+// a trail, and undo() rewinds the trail to an earlier mark.
+
+struct Change { // trail entry
+  int      w; // live word index, or -1-k for cov[k]
+  uint64_t m; // old live word
+};
+
+struct Gps { // grid placement status
+  vector<uint64_t> live;  // bit a -- placement a still fits
+  vector<char>     cov;   // cov[k] -- target k is covered
+  vector<Change>   trail; // changes made so far
+    Gps() : live(pw,~uint64_t(0)), cov(ltsq.size(),0) {
+      const int np = plc.size();
+      if ( np % 64 ) live[pw-1] = (uint64_t(1) << (np % 64)) - 1;
+    }
+    bool is_live(int a) const {
+      return live[a/64] >> (a%64) & 1;
+    }     
+    bool is_covered(int k) const {
+      return cov[k];
+    }
+    size_t mark() const { return trail.size(); }
+    void undo(size_t at) { // rewind the trail to mark at
+      while ( trail.size() > at ) {
+        const Change& c = trail.back();
+        if ( c.w >= 0 ) live[c.w]    = c.m;
+        else            cov[-1-c.w]  = 0;
+        trail.pop_back();
+      }
+    }
+    void print() const {
+      cout << "Gps: " << endl;
+      for ( size_t k = 0; k < ltsq.size(); k++ ) {
+        int n = 0;
+        for ( int a = pfirst[k]; a < pfirst[k+1]; a++ ) n += is_live(a);
+        ::print(ltsq[k]); cout << (cov[k] ? " covered" : " live ") << n << endl;
+      }
+    }
+};
+
+void place( Gps& gps, int a ) {
+  // place triangle a, i.e., mask out its conflicts and cover its target
+  const uint64_t* c = &cnfl[size_t(a)*pw];
+  for ( int w = 0; w < pw; w++ ) 
+    if ( gps.live[w] & c[w] ) {
+      gps.trail.push_back({w,gps.live[w]});
+      gps.live[w] &= ~c[w];
+    }
+  gps.trail.push_back({-1-plc[a].k,0});
+  gps.cov[plc[a].k] = 1;
+}
+
+//******************************************************************************
+// options() finds the total number of live placements of a target.
 // Let's define data structures that can be used to save options.
 
 struct Option {
   const Tm*    tm = 0;
   const Config cnfg;
+  int          a  = -1; // placement index in plc
   Option(){;}
-  Option(const Tm* t, const Config& cg ) : tm(t), cnfg(cg) {;}
+  Option(const Tm* t, const Config& cg, int pa ) : tm(t), cnfg(cg), a(pa) {;}
 };
 
-vector<vector<Option>> topt; // target options record
+typedef vector<vector<Option>> Topt; // options by target
+
+Topt topt; // target options record of the sequential search
 
 void init_topt() {
+  topt.clear();
   topt.resize(ltsq.size());
 }
 
-int options( const Gps& gps, const TCoord& tl ) {
-  // Finds options that fit and records them in topt, skips covered targers
-  const int tn = tt[tl.first][tl.second];
-  if ( gps.is_covered(tl) ) return 0;
-  int k = 0; while( ltsq[k] != tl) k++; // find the index of tl
+int options( const Gps& gps, int k, Topt& topt ) {
+  // Records live placements of target k in topt, skips covered targets
+  if ( gps.is_covered(k) ) return 0;
   topt[k].resize(0);
-  int res = 0;
-  for ( auto tm : n2tm[tt[tl.first][tl.second]] ) {
-    Config cnfg; 
-    auto count = [gps,tl,k,&res,tm,&cnfg]() {
-      for ( int p = 0; p < tm->p.size(); p++ ) { 
-        cnfg.p = p;
-        if ( fits(gps,tl,*tm,cnfg) ) { res++;
-          topt[k].emplace_back(tm,cnfg);
-        }
-      }
-    };
-                    count(); // h==0, v==0
-    cnfg.h = true;  count(); // h==1, v==0
-    cnfg.v = true;  count(); // h==1, v==1
-    cnfg.h = false; count(); // h==0, v==1
-    if ( tm->symmetrical() ) continue;
-    cnfg.s = true;  count(); // h==0, v==1
-    cnfg.v = false; count(); // h==0, v==0
-    cnfg.h = true;  count(); // h==1, v==0
-    cnfg.v = true;  count(); // h==1, v==1
+  const int b = pfirst[k], e = pfirst[k+1];
+  for ( int w = b/64; w <= (e-1)/64 && b < e; w++ ) {
+    uint64_t m = gps.live[w];
+    while ( m ) {
+      int a = w*64 + __builtin_ctzll(m); m &= m - 1;
+      if ( a < b  ) continue;
+      if ( a >= e ) break;
+      topt[k].emplace_back(plc[a].tm,plc[a].cnfg,a);
+    }
   }
-#if 0
-  cout << "target ";
-  print(tl); 
-  cout << " \t" << tt[tl.first][tl.second] << " \tres: " << res << endl;
-#endif
-  return res;
+  return topt[k].size();
 }
 
-void all_options(const Gps& gps ) {
+void all_options(const Gps& gps, Topt& topt ) {
   // find all options for targets that have not been covered
   long tot = 0L;
-  for ( auto sq : ltsq ) tot += options(gps,sq);
+  for ( size_t k = 0; k < ltsq.size(); k++ ) tot += options(gps,k,topt);
 #if 0
   cout << "all options: " << tot << endl;
 #endif
 }
 
 //******************************************************************************
-// Solve()
+// Branching heuristics.
+// A Pick chooses which uncovered target the search covers next:
+//   area -- largest number first (the original rule)
+//   mro  -- minimum remaining options, i.e. fewest live placements
+//   nbr  -- most constrained by neighbours, i.e. the most uncovered targets
+//           that share a conflict with one of its live placements
+// An Order sorts the options of the chosen target:
+//   gen  -- as generated
+//   lcv  -- least constraining value first, i.e. the placement that kills
+//           the fewest live placements of other targets
+// Options are tried from the back of topt[k], so an Order puts the 
+// preferred option last.
 
-void solve() {
-  vector<Gps> stack;   // For placement decisions
-    stack.reserve(ltsq.size()+2);
-    stack.resize(1);   // initial gps is empty
-  vector<int> picked;  // keeps the sequence of targets covered so far
-  auto pick_target = [&stack]() { // pick target by max size
-    auto& Top = stack[stack.size()-1];
-    int res = -2; int max = -1;
-    for( int k = 0; k < ltsq.size(); k++ ) {
-      auto t = ltsq[k];
-      if ( Top.is_covered(t) ) continue;
-      if ( topt[k].size() == 0 ) return -1; 
-      auto n = tt[t.first][t.second];
-      if ( n > 0 && n >= max ) { max = n;  res = k; }
+enum Pick  { p_area, p_mro, p_nbr, npick };
+enum Order { o_gen, o_lcv, norder };
+
+const char* pick_name [npick]  = { "area", "mro", "nbr" };
+const char* order_name[norder] = { "gen", "lcv" };
+
+struct Strategy { 
+  Pick  pick  = p_area;
+  Order order = o_gen;
+};
+
+bool quiet = false; // no solution output
+
+int neighbours( const Gps& gps, int k, const Topt& topt ) {
+  // n of uncovered targets that conflict with a live placement of target k
+  vector<uint64_t> u(pw,0); // union of conflicts of live placements of k
+  for ( const auto& opt : topt[k] ) {
+    const uint64_t* c = &cnfl[size_t(opt.a)*pw];
+    for ( int w = 0; w < pw; w++ ) u[w] |= c[w];
+  }
+  int res = 0;
+  for ( size_t j = 0; j < ltsq.size(); j++ ) {
+    if ( int(j) == k || gps.is_covered(j) ) continue;
+    for ( int a = pfirst[j]; a < pfirst[j+1]; a++ )
+      if ( gps.is_live(a) && (u[a/64] >> (a%64) & 1) ) { res++; break; }
+  }
+  return res;
+}
+
+int pick_target( const Gps& gps, const Topt& topt, Pick pk ) {
+  // -1 -- an uncovered target has no options, -2 -- all covered
+  int res = -2; int max = -1;
+  for( size_t k = 0; k < ltsq.size(); k++ ) {
+    auto t = ltsq[k];
+    if ( gps.is_covered(k) ) continue;
+    if ( topt[k].size() == 0 ) return -1; 
+    int n = 0;
+    switch ( pk ) {
+      case p_area: n = tt[t.first][t.second];            break;
+      case p_mro:  n = INT_MAX - int(topt[k].size());    break;
+      case p_nbr:  n = neighbours(gps,k,topt);                break;
+      default:     assert( 0 );
     }
-    return res;
-  };
-  auto put_triangle = [&stack](int pick) {
-    auto& Top = stack[stack.size()-1];
-        stack.emplace_back(Top);
-    const auto& vo = topt[pick];
-    auto& opt = vo[vo.size()-1];
-    auto& NewTop = stack[stack.size()-1];
-    place (NewTop,ltsq[pick],*opt.tm,opt.cnfg);
+    if ( pk == p_area ? n >= max : n > max ) { max = n;  res = k; }
+  }
+  return res;
+}
+
+void order_options( const Gps& gps, int k, Topt& topt, Order od ) {
+  if ( od != o_lcv ) return;
+  auto kills = [&gps](const Option& opt) { // live placements opt removes
+    const uint64_t* c = &cnfl[size_t(opt.a)*pw];
+    int n = 0;
+    for ( int w = 0; w < pw; w++ ) n += __builtin_popcountll(gps.live[w] & c[w]);
+    return n;
   };
-  bool found = false;
-  while( true ) {
-    all_options( stack[stack.size()-1]);
-    auto pick = pick_target();
-    if ( pick < 0 ) {
-      if ( pick < -1 ) { found = true;
+  vector<pair<int,int>> key; // (kills,index)
+  for ( size_t i = 0; i < topt[k].size(); i++ ) key.emplace_back(kills(topt[k][i]),i);
+  // most constraining first, so the least constraining is tried first
+  stable_sort(key.begin(),key.end(),[](const pair<int,int>& a, const pair<int,int>& b) {
+    return a.first > b.first; });
+  vector<Option> vo;
+  for ( const auto& e : key ) vo.emplace_back(topt[k][e.second]);
+  topt[k].swap(vo);
+}
+
+//******************************************************************************
+// Solve()
+
+long answer( const vector<int>& sol ) {
+  // product of odd horizontal leg lengths; sol[k] -- placement of target k
+  long sig = 1;
+  for ( size_t k = 0; k < sol.size(); k++ ) {
+    const auto& opt = plc[sol[k]];
+    auto tmp = hll(ltsq[k],*opt.tm,opt.cnfg);
+    if ( tmp % 2 ) sig *= tmp;
+  }
+  return sig;
+}
+
+void print_solution( const vector<int>& sol ) {
+  // sol[k] -- placement that covers target k
         cout << " SOLVED !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!! " << endl;
-        auto& Top = stack[stack.size()-1];
-        int sig = 1;
-        for ( int pck = 0; pck < picked.size(); pck++ ) {
-            const auto& vo = topt[pck];
-            auto& opt = vo[vo.size()-1];
+        for ( size_t pck = 0; pck < sol.size(); pck++ ) {
+            const auto& opt = plc[sol[pck]];
             print(ltsq[pck]);
                     print_troc (ltsq[pck],*opt.tm,opt.cnfg);
             cout << "\t" << hll(ltsq[pck],*opt.tm,opt.cnfg) << endl;
-            auto tmp = hll(ltsq[pck],*opt.tm,opt.cnfg);
-            if ( tmp % 2 ) sig *= tmp;
         }
-        cout << "Answer: " << sig << endl;
+        cout << "Answer: " << answer(sol) << endl;
+}
+
+struct Stats {
+  long   nodes = 0; // n of triangles placed
+  long   first = 0; // n of triangles placed up to the first solution
+  int    sols  = 0; // n of solutions
+  long   ans   = 0; // answer of the first solution
+  double ms    = 0; // run time
+};
+
+Stats solve( const Strategy& sg ) {
+  typedef chrono::steady_clock clk;
+  const auto t0 = clk::now();
+  Stats st;
+  Gps gps;             // initial gps is empty
+  vector<size_t> marks;  // gps trail mark before each placement decision
+    marks.reserve(ltsq.size()+2);
+  vector<int> picked;  // keeps the sequence of targets covered so far
+  auto put_triangle = [&gps,&marks,&st](int pick) {
+    marks.push_back(gps.mark());
+    const auto& vo = topt[pick];
+    auto& opt = vo[vo.size()-1];
+    place (gps,opt.a);
+    st.nodes++;
+  };
+  auto finish = [&st,&t0]() {
+    st.ms = chrono::duration<double,milli>(clk::now() - t0).count();
+    if ( quiet ) return;
+    if ( !st.sols ) cout << " FINISHED !!!!!  NO SOLUTION  !!!!!!!! " << endl;
+    else            cout << " FINISHED !!!!!  NO MORE SOLUTIONS  !!!!!!!! " << endl;
+  };
+  while( true ) {
+    all_options(gps,topt);
+    auto pick = pick_target(gps,topt,sg.pick);
+    if ( pick < 0 ) {
+      if ( pick < -1 ) { 
+        vector<int> sol;
+        for ( size_t k = 0; k < ltsq.size(); k++ ) sol.push_back(topt[k].back().a);
+        if ( !st.sols++ ) { st.first = st.nodes; st.ans = answer(sol); }
+        if ( !quiet ) print_solution(sol);
       }
       while( true ) {
-        stack.pop_back();      // erase failed attemp
+        if ( !picked.size() ) { // nothing to undo
+          finish();
+          return st;
+        }
+        gps.undo(marks.back()); // erase failed attemp
+        marks.pop_back();
         pick = picked.back();  // get last target decision
         topt[pick].pop_back(); // eliminate unsuccesful option
         if ( topt[pick].size() ) {
@@ -540,24 +783,278 @@ void solve() {
           picked.pop_back();
         } 
         if ( !picked.size() ) {
-            if ( !found ) cout << " FINISHED !!!!!  NO SOLUTION  !!!!!!!! " << endl;
-            else          cout << " FINISHED !!!!!  NO MORE SOLUTIONS  !!!!!!!! " << endl;
-          return;
+          finish();
+          return st;
         } 
       }
     }
+    order_options(gps,pick,topt,sg.order);
     picked.push_back(pick);
     PUT_TRIANGLE:
     put_triangle(pick);
   }
 }
 
+void print( const Strategy& sg, const Stats& st ) {
+  cout << "# pick " << pick_name[sg.pick] << ", order " << order_name[sg.order] 
+       << ": " << st.nodes << " nodes, " << st.first << " to the first, " 
+       << st.sols << " solutions, " 
+       << st.ms << " ms" << endl;
+}
+
+int compare() {
+  // run every strategy quietly and print its stats
+  quiet = true;
+  for ( int p = 0; p < npick; p++ )
+    for ( int o = 0; o < norder; o++ ) {
+      Strategy sg; sg.pick = Pick(p); sg.order = Order(o);
+      print(sg,solve(sg));
+    }
+  return 0;
+}
+
+//******************************************************************************
+// Parallel enumeration of all solutions.
+// Each worker owns a gps, option lists, and a deque of tasks. A task is the 
+// list of placements a subtree starts from. A worker takes tasks from the 
+// back of its own deque and steals from the front of the others'. While some
+// worker is idle, a worker that branches gives its untried options away as
+// tasks. Solutions are sorted before they are printed, so the output does not
+// depend on scheduling.
+
+struct Pool;
+
+struct Worker {
+  Pool*               pool;
+  Gps                 gps;
+  Topt                topt;
+  vector<int>         path;   // placements made, in order
+  deque<vector<int>>  tasks;
+  mutex               mx;     // guards tasks
+  long                nodes = 0;
+  long                steals = 0;
+  vector<vector<int>> sols;   // sol[k] -- placement that covers target k
+  Worker(Pool* p) : pool(p), topt(ltsq.size()) {;}
+  void push( const vector<int>& t );
+  bool take( vector<int>& t ) { // from the back of own deque
+    lock_guard<mutex> lk(mx);
+    if ( tasks.empty() ) return false;
+    t = tasks.back(); tasks.pop_back();
+    return true;
+  }
+  bool give( vector<int>& t ) { // from the front, to a thief
+    lock_guard<mutex> lk(mx);
+    if ( tasks.empty() ) return false;
+    t = tasks.front(); tasks.pop_front();
+    return true;
+  }
+  void run( const vector<int>& t );
+  void dfs();
+};
+
+struct Pool {
+  Strategy                   sg;
+  vector<unique_ptr<Worker>> ws;
+  atomic<long>               pending{0}; // tasks queued or running
+  atomic<int>                idle{0};    // n of workers without a task
+};
+
+void Worker::push( const vector<int>& t ) {
+  pool->pending++;
+  lock_guard<mutex> lk(mx);
+  tasks.push_back(t);
+}
+
+void Worker::run( const vector<int>& t ) {
+  gps.undo(0);
+  for ( int a : t ) place(gps,a);
+  if ( t.size() ) nodes++; // the last placement is this subtree's root
+  path = t;
+  dfs();
+}
+
+void Worker::dfs() {
+  all_options(gps,topt);
+  const int pick = pick_target(gps,topt,pool->sg.pick);
+  if ( pick == -2 ) {
+    vector<int> sol(ltsq.size());
+    for ( int a : path ) sol[plc[a].k] = a;
+    sols.push_back(sol);
+    return;
+  }
+  if ( pick < 0 ) return;
+  order_options(gps,pick,topt,pool->sg.order);
+  vector<Option> vo = topt[pick]; // deeper nodes rewrite topt
+  while ( vo.size() ) {
+    const int a = vo.back().a; vo.pop_back();
+    if ( vo.size() && pool->idle > 0 ) { // share the rest
+      for ( size_t i = vo.size(); i-- > 0; ) {
+        path.push_back(vo[i].a); push(path); path.pop_back();
+      }
+      vo.clear();
+    }
+    const size_t at = gps.mark();
+    place(gps,a); nodes++;
+    path.push_back(a);
+    dfs();
+    path.pop_back();
+    gps.undo(at);
+  }
+}
+
+void work( Pool& pl, int id ) {
+  Worker& w = *pl.ws[id];
+  const int nw = pl.ws.size();
+  bool idle = false;
+  while ( true ) {
+    vector<int> t;
+    bool got = w.take(t);
+    for ( int i = 1; !got && i < nw; i++ ) 
+      if ( (got = pl.ws[(id + i) % nw]->give(t)) ) w.steals++;
+    if ( got ) {
+      if ( idle ) { pl.idle--; idle = false; }
+      w.run(t);
+      pl.pending--;
+      continue;
+    }
+    if ( !idle ) { pl.idle++; idle = true; }
+    if ( pl.pending == 0 ) return;
+    this_thread::yield();
+  }
+}
+
+int solve_all( const Strategy& sg, int nthreads ) {
+  // enumerate all solutions with nthreads workers
+  typedef chrono::steady_clock clk;
+  const auto t0 = clk::now();
+  Pool pl; pl.sg = sg;
+  for ( int i = 0; i < nthreads; i++ ) pl.ws.emplace_back(new Worker(&pl));
+  pl.ws[0]->push(vector<int>());
+  vector<thread> th;
+  for ( int i = 0; i < nthreads; i++ ) th.emplace_back(work,ref(pl),i);
+  for ( auto& t : th ) t.join();
+  const double ms = chrono::duration<double,milli>(clk::now() - t0).count();
+  vector<vector<int>> sols;
+  long nodes = 0, steals = 0;
+  for ( const auto& w : pl.ws ) {
+    sols.insert(sols.end(),w->sols.begin(),w->sols.end());
+    nodes += w->nodes; steals += w->steals;
+  }
+  sort(sols.begin(),sols.end());
+  if ( !quiet ) for ( const auto& s : sols ) print_solution(s);
+  if ( !sols.size() ) cout << " FINISHED !!!!!  NO SOLUTION  !!!!!!!! " << endl;
+  else                cout << " FINISHED !!!!!  NO MORE SOLUTIONS  !!!!!!!! " << endl;
+  cout << "# " << nthreads << " workers, pick " << pick_name[sg.pick] 
+       << ", order " << order_name[sg.order] << ": " << nodes << " nodes, " 
+       << sols.size() << " solutions, " << steals << " steals, " << ms << " ms" << endl;
+  return 0;
+}
+
+//******************************************************************************
+// Boards read at run time. A board is its size, rows then columns, and then
+// its numbers row by row, 0 for an empty square; '#' starts a comment line.
+// Batch mode solves every board of a file and prints one line for each:
+// the solution count, the answer of the first solution (0 if none), the 
+// nodes and the time.
+
+int read_board( istream& in ) {
+  // reads the next board, makes it the table in use
+  // return : 1 = board read
+  //          0 = end of input
+  //         -1 = malformed board
+  auto next = [&in](int& v) { // next number, skips comments
+    while ( in >> ws && in.peek() == '#' ) in.ignore(1 << 30, '\n');
+    return bool(in >> v);
+  };
+  int r, c;
+  if ( !next(r) ) return 0;
+  if ( !next(c) || r < 1 || c < 1 ) return -1;
+  vector<vector<int>> t(r,vector<int>(c,0));
+  for ( auto& row : t )
+    for ( auto& n : row ) 
+      if ( !next(n) || n < 0 || n > maxn ) return -1;
+  tor = r; toc = c;
+  tt.swap(t);
+  return 1;
+}
+
+void init_board() { // tables of the board in use
+  init_ltsq();
+  init_ltsqp();
+  init_topt();
+  init_plc();
+}
+
+int batch( istream& in, const Strategy& sg ) {
+  typedef chrono::steady_clock clk;
+  const auto t0 = clk::now();
+  quiet = true;
+  size_t total = 0; // boards solved
+  int    res;
+  while ( (res = read_board(in)) > 0 ) {
+    total++;
+    init_board();
+    const Stats st = solve(sg);
+    cout << total << ' ' << tor << 'x' << toc << ": " << st.sols << " solutions, answer " 
+         << st.ans << ", " << st.nodes << " nodes, " << st.ms << " ms" << endl;
+  }
+  if ( res < 0 ) {
+    cout << "malformed board " << total + 1 << endl;
+    return 1;
+  }
+  cout << "# " << total << " boards, " 
+       << chrono::duration<double,milli>(clk::now() - t0).count() << " ms" << endl;
+  return 0;
+}
+
+template<class E>
+int lookup( const char* const* names, int n, const string& s, E& e ) {
+  for ( int i = 0; i < n; i++ ) if ( s == names[i] ) { e = E(i); return 1; }
+  cout << "unknown strategy " << s << endl;
+  return 0;
+}
 
 int main(int argc, char **argv) {
-    init_ltsq();
-    init_n2tm();
-    init_gmsqi();
-    init_topt();
-    solve();
+    string   opt;   // -cmp or -batch
+    string   file;  // board file; the built-in board if none (stdin for -batch)
+    Strategy sg;    // -pick area|mro|nbr, -order gen|lcv
+    bool     stats = false;
+    int      nthreads = 0; // -j n: enumerate with n workers
+    for ( int i = 1; i < argc; i++ ) {
+      const string arg = argv[i];
+      if      ( arg == "-j"     && i + 1 < argc ) nthreads = atoi(argv[++i]);
+      else if ( arg == "-pick"  && i + 1 < argc ) { 
+        if ( !lookup(pick_name,npick,argv[++i],sg.pick) ) return 1; 
+        stats = true;
+      }
+      else if ( arg == "-order" && i + 1 < argc ) {
+        if ( !lookup(order_name,norder,argv[++i],sg.order) ) return 1;
+        stats = true;
+      }
+      else if ( arg[0] == '-' ) opt  = arg;
+      else                      file = arg;
+    }
+    if ( opt == "-batch" ) {
+      if ( !file.size() ) return batch(cin,sg);
+      ifstream in(file);
+      if ( !in ) {
+        cout << "cannot open " << file << endl;
+        return 1;
+      }
+      return batch(in,sg);
+    }
+    init_tt();
+    if ( file.size() ) {
+      ifstream in(file);
+      if ( read_board(in) < 1 ) {
+        cout << "cannot read a board from " << file << endl;
+        return 1;
+      }
+    }
+    init_board();
+    if ( opt == "-cmp" ) return compare();
+    if ( nthreads > 0  ) return solve_all(sg,nthreads);
+    const Stats st = solve(sg);
+    if ( stats ) print(sg,st);
     return 0;
 }